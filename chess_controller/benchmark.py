@@ -0,0 +1,211 @@
+import argparse
+import json
+import random
+import sys
+import time
+
+import rclpy
+from rclpy.action import ActionClient
+from rclpy.node import Node
+from rclpy.utilities import remove_ros_args
+from action_msgs.msg import GoalStatus
+
+from chess_msgs.msg import GameConfig
+from chess_msgs.action import FindBestMove
+
+import chess
+
+from chess_controller.metrics import LatencyRecorder
+
+# Longest random game played out to get a benchmark position, in plies
+MAX_PLIES = 40
+
+
+class Benchmark(Node):
+    """
+    Load generator for the `chess/find_best_move` action.
+
+    Sends a fixed number of goals for random positions, keeping up to `concurrency` of them in
+    flight, cancels a share of them after a delay, and measures goal latency, cancel latency and
+    feedback rate.
+    """
+
+    def __init__(self, options):
+        super().__init__("chess_controller_benchmark")
+        self._options = options
+        self._random = random.Random(options.seed)
+
+        self._client = ActionClient(self, FindBestMove, "chess/find_best_move")
+        self._config_pub = self.create_publisher(GameConfig, "chess/game_config", 10)
+
+        self._sent = 0
+        self._in_flight = 0
+        self._statuses = {}
+        self._goal_latency = LatencyRecorder(options.goals)
+        self._cancel_latency = LatencyRecorder(options.goals)
+        self._feedback_count = 0
+        self._feedback_time = 0.0
+
+    def run(self):
+        """Send every goal and wait for all results, then report the measurements."""
+        if not self._client.wait_for_server(timeout_sec=self._options.timeout):
+            raise RuntimeError("The chess/find_best_move action server is not available")
+
+        # The node rejects goals until it has a game configuration
+        config = GameConfig()
+        config.time_increment = self._options.increment
+        self._config_pub.publish(config)
+        self._config_timer = self.create_timer(1.0, lambda: self._config_pub.publish(config))
+        time.sleep(0.5)
+
+        start = time.perf_counter()
+        while sum(self._statuses.values()) < self._options.goals:
+            while self._in_flight < self._options.concurrency and self._sent < self._options.goals:
+                self._send_goal()
+            rclpy.spin_once(self, timeout_sec=0.1)
+        duration = time.perf_counter() - start
+
+        return self._report(duration)
+
+    def _random_position(self):
+        """Play random moves from the starting position."""
+        board = chess.Board()
+        for _ in range(self._random.randint(0, MAX_PLIES)):
+            moves = list(board.legal_moves)
+            if not moves:
+                break
+            board.push(self._random.choice(moves))
+        if board.is_game_over():
+            board.pop()
+        return board
+
+    def _send_goal(self):
+        """Send a goal for a random position."""
+        goal = FindBestMove.Goal()
+        goal.fen.fen = self._random_position().fen()
+        goal.time.white_time_left = self._options.clock
+        goal.time.black_time_left = self._options.clock
+        goal.analysis_mode = self._options.analysis
+
+        state = {"sent": time.perf_counter(), "first_feedback": None, "feedback": 0}
+        cancel = self._random.random() < self._options.cancel_fraction
+
+        def feedback_callback(feedback):
+            now = time.perf_counter()
+            if state["first_feedback"] is None:
+                state["first_feedback"] = now
+            state["feedback"] += 1
+            state["last_feedback"] = now
+
+        self._sent += 1
+        self._in_flight += 1
+        future = self._client.send_goal_async(goal, feedback_callback=feedback_callback)
+        future.add_done_callback(lambda future: self._goal_response(future, state, cancel))
+
+    def _goal_response(self, future, state, cancel):
+        """Wait for the result of an accepted goal, and cancel it later if it was picked to."""
+        goal_handle = future.result()
+        if not goal_handle.accepted:
+            self._finish("rejected")
+            return
+
+        if cancel:
+
+            def cancel_goal():
+                timer.cancel()
+                state["cancel_requested"] = time.perf_counter()
+                goal_handle.cancel_goal_async()
+
+            timer = self.create_timer(self._options.cancel_after, cancel_goal)
+
+        goal_handle.get_result_async().add_done_callback(
+            lambda future: self._goal_result(future, state)
+        )
+
+    def _goal_result(self, future, state):
+        """Record the measurements of a finished goal."""
+        now = time.perf_counter()
+        status = future.result().status
+
+        if status == GoalStatus.STATUS_SUCCEEDED:
+            self._goal_latency.record(now - state["sent"])
+        if "cancel_requested" in state:
+            self._cancel_latency.record(now - state["cancel_requested"])
+        if state["feedback"] > 1:
+            self._feedback_count += state["feedback"] - 1
+            self._feedback_time += state["last_feedback"] - state["first_feedback"]
+
+        names = {
+            GoalStatus.STATUS_SUCCEEDED: "succeeded",
+            GoalStatus.STATUS_CANCELED: "canceled",
+            GoalStatus.STATUS_ABORTED: "aborted",
+        }
+        self._finish(names.get(status, "unknown"))
+
+    def _finish(self, outcome):
+        """Count a goal as done."""
+        self._in_flight -= 1
+        self._statuses[outcome] = self._statuses.get(outcome, 0) + 1
+
+    def _report(self, duration):
+        """Summarise the measurements as a JSON-ready dict."""
+        return {
+            "goals": self._options.goals,
+            "concurrency": self._options.concurrency,
+            "analysis_mode": self._options.analysis,
+            "duration": duration,
+            "outcomes": self._statuses,
+            "throughput": self._statuses.get("succeeded", 0) / duration,
+            "goal_latency": self._goal_latency.summary(),
+            "cancel_latency": self._cancel_latency.summary(),
+            "feedback_rate": (
+                self._feedback_count / self._feedback_time if self._feedback_time > 0 else None
+            ),
+        }
+
+
+def parse_options(args):
+    """Parse the benchmark's own command line arguments, without the program name."""
+    parser = argparse.ArgumentParser(description="Benchmark the chess controller action server")
+    parser.add_argument("--goals", type=int, default=100, help="number of goals to send")
+    parser.add_argument("--concurrency", type=int, default=1, help="goals kept in flight")
+    parser.add_argument("--clock", type=int, default=60000, help="clock of both sides, in ms")
+    parser.add_argument("--increment", type=int, default=0, help="increment per move, in ms")
+    parser.add_argument("--analysis", action="store_true", help="send analysis mode goals")
+    parser.add_argument(
+        "--cancel-fraction", type=float, default=0.0, help="share of the goals to cancel"
+    )
+    parser.add_argument(
+        "--cancel-after", type=float, default=0.5, help="seconds before canceling a goal"
+    )
+    parser.add_argument("--seed", type=int, default=0, help="seed of the random positions")
+    parser.add_argument(
+        "--timeout", type=float, default=10.0, help="seconds to wait for the action server"
+    )
+    parser.add_argument("--output", help="file to write the JSON report to instead of stdout")
+    return parser.parse_args(args)
+
+
+def main(args=None):
+    # rcl expects the program name first, like in `sys.argv`
+    args = sys.argv if args is None else args
+    options = parse_options(remove_ros_args(args)[1:])
+    rclpy.init(args=args)
+
+    benchmark = Benchmark(options)
+    try:
+        report = benchmark.run()
+    finally:
+        benchmark.destroy_node()
+        rclpy.shutdown()
+
+    text = json.dumps(report, indent=2)
+    if options.output:
+        with open(options.output, "w") as file:
+            file.write(text + "\n")
+    else:
+        print(text)
+
+
+if __name__ == "__main__":
+    main()
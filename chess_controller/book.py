@@ -0,0 +1,34 @@
+import chess.polyglot
+
+# Ways of choosing between the moves a book has for a position
+BOOK_SELECTIONS = ("weighted", "best")
+
+
+class OpeningBook:
+    """
+    A Polyglot opening book.
+
+    The book file is memory-mapped and binary-searched by the position's Zobrist key, so a lookup
+    neither reads the whole book nor talks to an engine.
+    """
+
+    def __init__(self, path, selection):
+        if selection not in BOOK_SELECTIONS:
+            raise ValueError(f"Unknown opening book selection `{selection}`")
+        self._reader = chess.polyglot.open_reader(path)
+        self._selection = selection
+
+    def move(self, board):
+        """Pick a book move for the position of `board`, or `None` if it is out of book."""
+        try:
+            if self._selection == "weighted":
+                entry = self._reader.weighted_choice(board)
+            else:
+                entry = self._reader.find(board)
+        except IndexError:
+            return None
+        return entry.move if board.is_legal(entry.move) else None
+
+    def close(self):
+        """Unmap the book file."""
+        self._reader.close()
@@ -0,0 +1,117 @@
+import collections
+import dataclasses
+import math
+import threading
+
+import chess
+import chess.polyglot
+
+# Rough memory used by one cache entry, including its key and the OrderedDict's bookkeeping
+ENTRY_BYTES = 512
+
+# Number of recent searches the depth estimate is fitted to
+DEPTH_SAMPLES = 64
+
+
+@dataclasses.dataclass
+class CachedMove:
+    """The outcome of a finished search for the best move in a position."""
+
+    move: chess.Move
+    score: object
+    depth: int
+    time: float
+
+
+def clock_bucket(clock):
+    """Group clock times by their power of two in seconds, so similar clocks share entries."""
+    return int(math.log2(max(clock, 1.0)))
+
+
+class ResultCache:
+    """
+    Search results by position, evicting the least recently used entries.
+
+    Positions are keyed by their Zobrist hash, so transpositions share an entry, together with the
+    bucket of the side to move's clock. The number of entries is bounded by a memory budget.
+    """
+
+    def __init__(self, max_bytes):
+        self._capacity = max(1, max_bytes // ENTRY_BYTES)
+        self._lock = threading.Lock()
+        self._entries = collections.OrderedDict()
+        self.hits = 0
+        self.misses = 0
+
+    @staticmethod
+    def _key(board, clock):
+        return chess.polyglot.zobrist_hash(board), clock_bucket(clock)
+
+    def get(self, board, clock):
+        """Get the result stored for the position of `board`, or `None`."""
+        key = self._key(board, clock)
+        with self._lock:
+            entry = self._entries.get(key)
+            if entry is None:
+                self.misses += 1
+                return None
+            self.hits += 1
+            self._entries.move_to_end(key)
+            return entry
+
+    def summary(self):
+        """Summarise the lookups so far as a JSON-ready dict."""
+        with self._lock:
+            entries, hits, misses = len(self._entries), self.hits, self.misses
+        lookups = hits + misses
+        return {
+            "entries": entries,
+            "hits": hits,
+            "misses": misses,
+            "hit_rate": hits / lookups if lookups else None,
+        }
+
+    def put(self, board, clock, entry):
+        """Store the result of a search of the position of `board`, unless a deeper one exists."""
+        key = self._key(board, clock)
+        with self._lock:
+            stored = self._entries.get(key)
+            if stored is None or stored.depth <= entry.depth:
+                self._entries[key] = entry
+            self._entries.move_to_end(key)
+            while len(self._entries) > self._capacity:
+                self._entries.popitem(last=False)
+
+
+class DepthEstimator:
+    """
+    Estimates the depth a search will reach in a given time, from the searches seen so far.
+
+    Depth grows roughly linearly with the logarithm of the search time, so a line is fitted to the
+    depth against the log of the time of the most recent searches.
+    """
+
+    def __init__(self, samples=DEPTH_SAMPLES):
+        self._lock = threading.Lock()
+        self._samples = collections.deque(maxlen=samples)
+
+    def record(self, seconds, depth):
+        """Add the time and depth of a finished search."""
+        if seconds > 0 and depth:
+            with self._lock:
+                self._samples.append((math.log2(seconds), depth))
+
+    def expected_depth(self, seconds):
+        """Estimate the depth reached in `seconds`, or `None` without enough samples."""
+        with self._lock:
+            samples = list(self._samples)
+        if len(samples) < 2 or seconds <= 0:
+            return None
+
+        mean_x = sum(x for x, _ in samples) / len(samples)
+        mean_y = sum(y for _, y in samples) / len(samples)
+        variance = sum((x - mean_x) ** 2 for x, _ in samples)
+        if variance == 0:
+            return mean_y
+        slope = sum((x - mean_x) * (y - mean_y) for x, y in samples) / variance
+        return mean_y + slope * (math.log2(seconds) - mean_x)
@@ -1,17 +1,70 @@
 import rclpy
 from rclpy.node import Node
 from rclpy.action import ActionServer, CancelResponse, GoalResponse
-from rclpy.callback_groups import ReentrantCallbackGroup
-from rcl_interfaces.msg import ParameterDescriptor
+from rclpy.callback_groups import MutuallyExclusiveCallbackGroup, ReentrantCallbackGroup
+from rclpy.executors import MultiThreadedExecutor, SingleThreadedExecutor
+from rclpy.qos import DurabilityPolicy, QoSProfile
+from rcl_interfaces.msg import IntegerRange, ParameterDescriptor, SetParametersResult
+
+from std_msgs.msg import Bool, String
+from std_srvs.srv import Trigger
 
 from chess_msgs.msg import GameConfig
 from chess_msgs.action import FindBestMove
 
-import threading
+import asyncio
+import dataclasses
+import time
 
 import chess
 import chess.engine
 
+from chess_controller.book import OpeningBook
+from chess_controller.cache import CachedMove, DepthEstimator, ResultCache
+from chess_controller.engine_pool import (
+    ANALYSIS_PRIORITY,
+    PLAY_PRIORITY,
+    EnginePool,
+    RestartPolicy,
+)
+from chess_controller.event_loop import EventLoopThread
+from chess_controller.feedback import FeedbackAggregator
+from chess_controller import large_pages
+from chess_controller.metrics import GoalMetrics
+from chess_controller.placement import Placement
+from chess_controller.resources import available_cpus, available_memory, engine_sizes
+from chess_controller.session import SessionManager
+from chess_controller.speculator import Speculator
+from chess_controller.tablebase import Tablebase
+from chess_controller.time_manager import TimeManager, own_clock
+from chess_controller.watchdog import Watchdog
+from chess_controller import uci_parameters
+
+# Info requested from play mode searches, for caching their results and falling back to their best
+# move if the engine hangs
+SEARCH_INFO = chess.engine.INFO_BASIC | chess.engine.INFO_SCORE | chess.engine.INFO_PV
+
+# How long a stopped goal waits for the action server to move it into the canceling state
+CANCEL_STATE_TIMEOUT = 1.0
+
+# What a goal that would have to wait for an engine may cut short, by preemption policy
+PREEMPTION_POLICIES = ("none", "speculation", "analysis")
+
+# How often a goal is retried on a respawned engine after its engine crashed
+ENGINE_CRASH_RETRIES = 2
+
+# Largest share of its clock an engine is expected to spend on one move. A search under a clock
+# limit running longer than that, plus the increment and the watchdog grace, is considered hung.
+MAX_CLOCK_FRACTION = 0.3
+
+# How long a hung engine gets to answer `stop` before it is killed
+WATCHDOG_STOP_TIMEOUT = 1.0
+
+
+def goal_key(goal_handle):
+    """Get a hashable identifier of a goal."""
+    return bytes(goal_handle.goal_id.uuid)
+
 
 class ChessEngineActionServer(Node):
     def __init__(self):
@@ -23,24 +76,433 @@ class ChessEngineActionServer(Node):
             "stockfish",
             ParameterDescriptor(description="Path to the chess engine executable"),
         )
+        self.declare_parameter(
+            "engine_pool_size",
+            1,
+            ParameterDescriptor(
+                description="Number of engine processes searching goals in parallel",
+                read_only=True,
+            ),
+        )
+        self.declare_parameter(
+            "engine_threads",
+            1,
+            ParameterDescriptor(
+                description="Initial value of the `Threads` option of every engine", read_only=True
+            ),
+        )
+        self.declare_parameter(
+            "engine_hash",
+            16,
+            ParameterDescriptor(
+                description="Initial value of the `Hash` option of every engine, in MB",
+                read_only=True,
+            ),
+        )
+        self.declare_parameter(
+            "auto_size_engines",
+            False,
+            ParameterDescriptor(
+                description="Size `Threads` and `Hash` from the CPUs and memory available instead "
+                "of `engine_threads` and `engine_hash`",
+                read_only=True,
+            ),
+        )
+        self.declare_parameter(
+            "reserved_cpus",
+            1,
+            ParameterDescriptor(
+                description="CPUs left to the rest of the system when sizing the engines",
+                read_only=True,
+            ),
+        )
+        self.declare_parameter(
+            "hash_memory_fraction",
+            0.5,
+            ParameterDescriptor(
+                description="Fraction of the available memory given to the engines' hash tables "
+                "when sizing the engines",
+                read_only=True,
+            ),
+        )
+        self.declare_parameter(
+            "engine_cpus",
+            "",
+            ParameterDescriptor(
+                description="CPU lists to pin the engines to, one per engine separated by `;`, "
+                "like `2-3;4-5`",
+                read_only=True,
+            ),
+        )
+        self.declare_parameter(
+            "engine_numa_nodes",
+            "",
+            ParameterDescriptor(
+                description="NUMA nodes to bind the engines to, one per engine separated by `;`",
+                read_only=True,
+            ),
+        )
+        self.declare_parameter(
+            "engine_scheduling",
+            "",
+            ParameterDescriptor(
+                description="Scheduling policy of the engines: `other`, `batch`, `idle` or empty "
+                "for the node's own",
+                read_only=True,
+            ),
+        )
+        self.declare_parameter(
+            "engine_nice",
+            0,
+            ParameterDescriptor(
+                description="Nice value of the engines (0 for the node's own)", read_only=True
+            ),
+        )
+        self.declare_parameter(
+            "engine_large_pages",
+            "",
+            ParameterDescriptor(
+                description="Huge pages backing the engines' memory: `transparent`, `explicit` or "
+                "empty to leave it to the engine",
+                read_only=True,
+            ),
+        )
+        self.declare_parameter(
+            "engine_lock_memory",
+            False,
+            ParameterDescriptor(
+                description="Raise the locked memory limit of the engines to the maximum allowed",
+                read_only=True,
+            ),
+        )
+        self.declare_parameter(
+            "warm_up_time",
+            0.5,
+            ParameterDescriptor(
+                description="Seconds every engine searches at startup before goals are accepted "
+                "(0 to skip)",
+                read_only=True,
+            ),
+        )
+        self.declare_parameter(
+            "engine_max_restarts",
+            5,
+            ParameterDescriptor(
+                description="Number of times an engine is respawned within the restart window "
+                "before it is given up on",
+                read_only=True,
+            ),
+        )
+        self.declare_parameter(
+            "engine_restart_window",
+            300.0,
+            ParameterDescriptor(
+                description="Seconds over which engine restarts are counted", read_only=True
+            ),
+        )
+        self.declare_parameter(
+            "watchdog_grace",
+            2.0,
+            ParameterDescriptor(
+                description="Seconds a search may overrun its time budget before the engine is "
+                "considered hung"
+            ),
+        )
+        self.declare_parameter(
+            "time_management",
+            "engine",
+            ParameterDescriptor(
+                description="How play mode searches are timed: `engine` for adjusted clocks or "
+                "`movetime` for a fixed time",
+                read_only=True,
+            ),
+        )
+        self.declare_parameter(
+            "motion_overhead",
+            5.0,
+            ParameterDescriptor(
+                description="Initial estimate of the seconds the robot takes to make a move",
+                read_only=True,
+            ),
+        )
+        self.declare_parameter(
+            "motion_overhead_learning_rate",
+            0.3,
+            ParameterDescriptor(
+                description="Weight of each observed overhead in the motion overhead estimate "
+                "(0 to keep the initial estimate)",
+                read_only=True,
+            ),
+        )
+        self.declare_parameter(
+            "time_reserve",
+            2.0,
+            ParameterDescriptor(
+                description="Seconds of the clock never planned to be spent", read_only=True
+            ),
+        )
+        self.declare_parameter(
+            "metrics_period",
+            10.0,
+            ParameterDescriptor(
+                description="Seconds between latency metrics messages (0 to disable)",
+                read_only=True,
+            ),
+        )
+        self.declare_parameter(
+            "executor_threads",
+            4,
+            ParameterDescriptor(
+                description="Number of threads running the node's callbacks", read_only=True
+            ),
+        )
+        self.declare_parameter(
+            "max_queued_goals",
+            8,
+            ParameterDescriptor(
+                description="Number of goals that may wait for an engine before more are rejected",
+                read_only=True,
+            ),
+        )
+        self.declare_parameter(
+            "preemption_policy",
+            "speculation",
+            ParameterDescriptor(
+                description="What goals waiting for an engine may cut short: `none`, "
+                "`speculation` or `analysis` (analysis goals and speculation, for play goals)"
+            ),
+        )
+        self.declare_parameter(
+            "feedback_rate",
+            10.0,
+            ParameterDescriptor(
+                description="Maximum feedback messages per second and goal (0 for no limit)"
+            ),
+        )
+        self.declare_parameter(
+            "analysis_multipv",
+            1,
+            ParameterDescriptor(
+                description="Number of ranked candidate moves analysis mode goals search for",
+                integer_range=[IntegerRange(from_value=1, to_value=500, step=1)],
+            ),
+        )
+        self.declare_parameter(
+            "session_ttl",
+            600.0,
+            ParameterDescriptor(
+                description="Seconds without a goal after which a game's session is dropped",
+                read_only=True,
+            ),
+        )
+        self.declare_parameter(
+            "max_sessions",
+            32,
+            ParameterDescriptor(
+                description="Number of games tracked at once before the least recently used one "
+                "is dropped",
+                read_only=True,
+            ),
+        )
+        self.declare_parameter(
+            "ponder",
+            False,
+            ParameterDescriptor(
+                description="Keep searching the expected reply while the opponent is thinking"
+            ),
+        )
+
+        self.declare_parameter(
+            "speculation_replies",
+            0,
+            ParameterDescriptor(
+                description="Number of likely opponent replies to search ahead (0 to disable)"
+            ),
+        )
+        self.declare_parameter(
+            "speculation_time",
+            1.0,
+            ParameterDescriptor(description="Seconds spent searching each speculated reply"),
+        )
+        self.declare_parameter(
+            "result_cache_size",
+            16,
+            ParameterDescriptor(
+                description="Memory available for caching search results by position, in MB",
+                read_only=True,
+            ),
+        )
+
+        self.declare_parameter(
+            "opening_book_path",
+            "",
+            ParameterDescriptor(
+                description="Path to a Polyglot opening book answering play mode goals in book",
+                read_only=True,
+            ),
+        )
+        self.declare_parameter(
+            "opening_book_selection",
+            "weighted",
+            ParameterDescriptor(
+                description="How to choose between book moves: `weighted` or `best`",
+                read_only=True,
+            ),
+        )
 
-        # Subscribe to the game configuration topic
+        self.declare_parameter(
+            "syzygy_path",
+            "",
+            ParameterDescriptor(
+                description="Directories of Syzygy tablebases, separated by `:`", read_only=True
+            ),
+        )
+        self.declare_parameter(
+            "syzygy_probe_limit",
+            7,
+            ParameterDescriptor(
+                description="Maximum number of pieces of positions looked up in the tablebases",
+                read_only=True,
+            ),
+        )
+
+        # Latched readiness, so nodes starting later see it too
+        self._ready_pub = self.create_publisher(
+            Bool,
+            "chess/controller_ready",
+            QoSProfile(depth=1, durability=DurabilityPolicy.TRANSIENT_LOCAL),
+        )
+        self._ready_pub.publish(Bool(data=False))
+
+        # Subscribe to the game configuration topic. Configuration updates, metrics and goals each
+        # have their own callback group, so none of them waits for the others on a multi-threaded
+        # executor.
         self._current_game_config = None
         self._game_config_sub = self.create_subscription(
             GameConfig,
             "chess/game_config",
             lambda cfg: setattr(self, "_current_game_config", cfg),
             10,
+            callback_group=MutuallyExclusiveCallbackGroup(),
+        )
+
+        # All engines are driven from one asyncio event loop. Goals await their searches on it, and
+        # the guard condition wakes the executor whenever a result is ready.
+        self._wake_guard = self.create_guard_condition(lambda: None)
+        self._loop = EventLoopThread(self._wake_guard.trigger)
+
+        # Start the chess engine processes. Goals wait for a free engine instead of preempting each
+        # other.
+        engine_options = {
+            "Threads": self.get_parameter("engine_threads").value,
+            "Hash": self.get_parameter("engine_hash").value,
+        }
+        if self.get_parameter("auto_size_engines").value:
+            engine_options["Threads"], engine_options["Hash"] = self._auto_size_engines()
+        if self.get_parameter("syzygy_path").value:
+            engine_options["SyzygyPath"] = self.get_parameter("syzygy_path").value
+        placements = Placement.for_pool(
+            self.get_parameter("engine_pool_size").value,
+            self.get_parameter("engine_cpus").value,
+            self.get_parameter("engine_numa_nodes").value,
+            self.get_parameter("engine_scheduling").value,
+            self.get_parameter("engine_nice").value,
+        )
+        engine_env = self._prepare_large_pages(engine_options)
+        self._pool = self._loop.run_sync(
+            EnginePool.start(
+                self.get_parameter("engine_path").value,
+                self.get_parameter("engine_pool_size").value,
+                engine_options,
+                self.get_logger(),
+                placements,
+                engine_env,
+                RestartPolicy(
+                    self.get_parameter("engine_max_restarts").value,
+                    self.get_parameter("engine_restart_window").value,
+                ),
+            )
         )
+        self._report_large_pages()
+        self._declare_uci_parameters(engine_options)
+        self._warm_up()
 
-        # Only a single goal can be active at a time
-        self._goal_handle = None
-        self._goal_lock = threading.Lock()
+        # Move history of every game in progress, so the engines see whole games instead of
+        # unrelated positions
+        self._sessions = SessionManager(
+            self.get_parameter("session_ttl").value,
+            self.get_logger(),
+            self.get_parameter("max_sessions").value,
+        )
+
+        # Opening moves are taken from the book without involving an engine
+        self._book = None
+        if self.get_parameter("opening_book_path").value:
+            self._book = OpeningBook(
+                self.get_parameter("opening_book_path").value,
+                self.get_parameter("opening_book_selection").value,
+            )
+
+        # Endgames covered by the tablebases are answered without involving an engine either
+        self._tablebase = None
+        if self.get_parameter("syzygy_path").value:
+            self._tablebase = Tablebase(
+                self.get_parameter("syzygy_path").value,
+                self.get_parameter("syzygy_probe_limit").value,
+            )
+
+        # Search times planned around the time the arm takes to move
+        self._time_manager = TimeManager(
+            self.get_parameter("time_management").value,
+            self.get_parameter("motion_overhead").value,
+            self.get_parameter("motion_overhead_learning_rate").value,
+            self.get_parameter("time_reserve").value,
+            self.get_logger(),
+        )
 
-        # Start the chess engine process
-        self._engine = chess.engine.SimpleEngine.popen_uci(self.get_parameter("engine_path").value)
+        # Results of earlier searches by position, reused when they are about as deep as a new
+        # search would get
+        self._result_cache = ResultCache(self.get_parameter("result_cache_size").value * 2**20)
+        self._depth_estimator = DepthEstimator()
 
-        # Create action server for finding the best move
+        # Replies to the opponent's likely moves, searched on idle engines while they think, and
+        # cut short for waiting goals as the preemption policy allows. The policy may change at
+        # runtime, where the parameter callback validates it.
+        self._speculator = Speculator(self._pool, self._result_cache, self.get_logger())
+        preemption_policy = self.get_parameter("preemption_policy").value
+        if preemption_policy not in PREEMPTION_POLICIES:
+            raise ValueError(f"Unknown preemption policy '{preemption_policy}'")
+
+        # Functions stopping the searches in progress and the time their goals were asked to stop,
+        # by goal, and the deadline and stop function of analysis searches play goals may preempt.
+        # All are only touched on the engine event loop.
+        self._searches = {}
+        self._interrupt_times = {}
+        self._analysis_searches = {}
+
+        # Latency of every phase of the goals, published periodically and on request. Goals are
+        # timed from their arrival, by request until they are accepted and by goal after that.
+        self._metrics = GoalMetrics()
+        self._goal_arrivals = {}
+        self._goal_timings = {}
+        self._metrics_pub = self.create_publisher(String, "chess/controller_metrics", 10)
+        metrics_group = MutuallyExclusiveCallbackGroup()
+        if self.get_parameter("metrics_period").value > 0:
+            self._metrics_timer = self.create_timer(
+                self.get_parameter("metrics_period").value,
+                self._publish_metrics,
+                callback_group=metrics_group,
+            )
+        self._metrics_srv = self.create_service(
+            Trigger,
+            "chess/get_controller_metrics",
+            self._get_metrics,
+            callback_group=metrics_group,
+        )
+
+        # Create action server for finding the best move. rclpy gives an action server a single
+        # callback group for goal intake, cancellation and execution, so it has to be reentrant
+        # for cancel requests to be handled while goals execute.
         self._action_server = ActionServer(
             self,
             FindBestMove,
@@ -52,31 +514,169 @@ class ChessEngineActionServer(Node):
             callback_group=ReentrantCallbackGroup(),
         )
 
-        self.get_logger().info("Chess engine action server is up")
+        self.get_logger().info(f"Chess engine action server is up with {self._pool.size} engines")
+        self._ready_pub.publish(Bool(data=True))
+
+    def _auto_size_engines(self):
+        """Split the CPUs and memory available to the node (or its container) between engines."""
+        cpus, memory = available_cpus(), available_memory()
+        threads, hash_mb = engine_sizes(
+            self.get_parameter("engine_pool_size").value,
+            cpus,
+            memory,
+            self.get_parameter("reserved_cpus").value,
+            self.get_parameter("hash_memory_fraction").value,
+        )
+
+        memory_mb = memory // 2**20 if memory is not None else "unknown"
+        self.get_logger().info(
+            f"Sized engines for {cpus} CPUs and {memory_mb} MB of memory: "
+            f"Threads={threads}, Hash={hash_mb} MB"
+        )
+        return threads, hash_mb
+
+    def _warm_up(self):
+        """Search briefly on every engine, so the first goal is as fast as later ones."""
+        warm_up_time = self.get_parameter("warm_up_time").value
+        if warm_up_time <= 0:
+            return
+
+        start = time.monotonic()
+        self._loop.run_sync(self._pool.warm_up(warm_up_time))
+        self.get_logger().info(
+            f"Warmed up {self._pool.size} engines in {time.monotonic() - start:.2f} s"
+        )
+
+    def _prepare_large_pages(self, engine_options):
+        """
+        Check that the kernel can back the engines' hash tables with huge pages.
+
+        Returns the environment to start the engines with, or `None` to inherit the node's.
+        """
+        if self.get_parameter("engine_lock_memory").value:
+            limit = large_pages.raise_memlock_limit()
+            limit = "unlimited" if limit is None else f"{limit // 2**10} kB"
+            self.get_logger().info(f"Locked memory limit of the engines: {limit}")
+
+        mode = self.get_parameter("engine_large_pages").value
+        if not mode:
+            return None
+        if mode not in large_pages.LARGE_PAGE_MODES:
+            raise ValueError(f"Unknown large page mode '{mode}'")
+
+        if mode == "transparent":
+            thp_mode = large_pages.transparent_huge_pages()
+            if thp_mode not in ("always", "madvise"):
+                self.get_logger().warning(f"Transparent huge pages are not enabled ({thp_mode})")
+        else:
+            hash_bytes = engine_options["Hash"] * 2**20
+            needed = hash_bytes * self.get_parameter("engine_pool_size").value
+            if large_pages.free_huge_pages() < needed:
+                self.get_logger().warning(
+                    f"Only {large_pages.free_huge_pages() // 2**20} MB of explicit huge pages are "
+                    f"free for {needed // 2**20} MB of hash, the rest uses regular pages"
+                )
+        return large_pages.engine_environment(mode)
+
+    def _report_large_pages(self):
+        """Log how much of every engine's memory is actually backed by huge pages."""
+        if not self.get_parameter("engine_large_pages").value:
+            return
+        for worker in self._pool.workers:
+            transparent, explicit = large_pages.huge_page_usage(worker.transport.get_pid())
+            self.get_logger().info(
+                f"Engine {worker.index} uses {transparent // 2**20} MB of transparent and "
+                f"{explicit // 2**20} MB of explicit huge pages"
+            )
+
+    def _declare_uci_parameters(self, engine_options):
+        """
+        Declare a `uci.` parameter for every option the engines advertise.
 
-    def destroy(self):
-        self._transport.close()
-        self._asyncio_loop.close()
+        Values given for them at startup are applied right away, later changes between goals.
+        """
+        self._uci_options = {}
+        startup_options = {}
+        for option in self._pool.engine_options.values():
+            if not uci_parameters.is_exposed(option):
+                continue
+
+            name = uci_parameters.parameter_name(option)
+            current = engine_options.get(option.name, uci_parameters.default_value(option))
+            value = self.declare_parameter(name, current, uci_parameters.descriptor(option)).value
+            self._uci_options[name] = option
+            if value != current:
+                startup_options[option.name] = value
+
+        if startup_options:
+            self._loop.run_sync(self._pool.configure(startup_options))
+        self.add_on_set_parameters_callback(self._on_set_parameters)
+
+    def _on_set_parameters(self, parameters):
+        """Validate parameter changes, passing those to `uci.` parameters on to the engines."""
+        changes = {}
+        for parameter in parameters:
+            if parameter.name == "preemption_policy":
+                if parameter.value not in PREEMPTION_POLICIES:
+                    return SetParametersResult(
+                        successful=False, reason=f"Unknown preemption policy '{parameter.value}'"
+                    )
+                continue
+            option = self._uci_options.get(parameter.name)
+            if option is None:
+                continue
+            reason = uci_parameters.validate(option, parameter.value)
+            if reason is not None:
+                return SetParametersResult(successful=False, reason=reason)
+            changes[option.name] = parameter.value
+
+        if changes:
+            self._loop.run(self._configure_engines(changes))
+        return SetParametersResult(successful=True)
+
+    async def _configure_engines(self, options):
+        """Apply changed `uci.` parameters to the engines, logging what could not be applied."""
+        try:
+            await self._pool.configure(options)
+        except (Exception, asyncio.CancelledError) as error:
+            # Nothing awaits this coroutine, so the error would be lost otherwise
+            self.get_logger().error(f"Could not apply {options} to the engines: {error!r}")
+
+    def destroy_node(self):
+        self._ready_pub.publish(Bool(data=False))
         self._action_server.destroy()
+        self._loop.run_sync(self._pool.close())
+        self._loop.close()
+        if self._book is not None:
+            self._book.close()
+        if self._tablebase is not None:
+            self._tablebase.close()
         super().destroy_node()
 
     def goal_callback(self, goal_request):
         """Accept or reject a client request to begin an action."""
+        received = time.perf_counter()
         self.get_logger().info("Received goal request")
 
         if self._current_game_config is None:
             self.get_logger().error("The `game_configuration` topic has not been published to yet")
             return GoalResponse.REJECT
 
+        if self._pool.queue_depth >= self.get_parameter("max_queued_goals").value:
+            self.get_logger().error("Too many goals are waiting for an engine")
+            return GoalResponse.REJECT
+
+        # The action server hands the same request object to the goal handle
+        self._goal_arrivals[id(goal_request)] = received
+
         return GoalResponse.ACCEPT
 
     def handle_accepted_callback(self, goal_handle):
         """Start execution of a goal."""
-        with self._goal_lock:
-            if self._goal_handle is not None and self._goal_handle.is_active:
-                self.get_logger().info("Aborting previous goal")
-                self._goal_handle.abort()
-            self._goal_handle = goal_handle
+        received = self._goal_arrivals.pop(id(goal_handle.request), time.perf_counter())
+        timing = self._metrics.start(received)
+        timing.mark("accept")
+        self._goal_timings[goal_key(goal_handle)] = timing
 
         self.get_logger().info("Starting execution of goal")
         goal_handle.execute()
@@ -85,15 +685,102 @@ class ChessEngineActionServer(Node):
         """Accept or reject a client request to cancel an action."""
         self.get_logger().info("Received cancel request")
 
+        # Canceling a play mode goal makes the engine move now with the best move found so far
         if goal_handle.request.analysis_mode:
             self.get_logger().info("Cancelling analysis mode")
-            return CancelResponse.ACCEPT
         else:
-            self.get_logger().warn("Cannot cancel play mode")
-            return CancelResponse.REJECT
+            self.get_logger().info("Moving now in play mode")
+        self._loop.call_soon(self._interrupt, goal_handle, time.monotonic())
+        return CancelResponse.ACCEPT
+
+    def _interrupt(self, goal_handle, requested_at):
+        """Stop a goal's search right away instead of at the engine's next info line."""
+        key = goal_key(goal_handle)
+        self._interrupt_times.setdefault(key, requested_at)
+
+        stop = self._searches.get(key)
+        if stop is not None:
+            stop()
+        else:
+            # The goal may still be waiting for an engine
+            asyncio.ensure_future(self._pool.wake())
 
-    def execute_callback(self, goal_handle):
+    def _is_interrupted(self, goal_handle):
+        """Check whether a goal has been canceled or aborted."""
+        return (
+            goal_key(goal_handle) in self._interrupt_times
+            or goal_handle.is_cancel_requested
+            or not goal_handle.is_active
+        )
+
+    def _record_cancel_latency(self, goal_handle):
+        """Record how long the engine took to become idle after a goal was asked to stop."""
+        requested_at = self._interrupt_times.pop(goal_key(goal_handle), None)
+        if requested_at is None:
+            return
+
+        latency = time.monotonic() - requested_at
+        self._metrics.cancel.record(latency)
+        self.get_logger().info(
+            f"Engine idle {latency * 1000:.1f}ms after cancel request "
+            f"(p99 {self._metrics.cancel.percentile(0.99) * 1000:.1f}ms)"
+        )
+
+    def _mark(self, goal_handle, phase):
+        """Record that a phase of a goal has just ended."""
+        timing = self._goal_timings.get(goal_key(goal_handle))
+        if timing is not None:
+            timing.mark(phase)
+
+    def _publish_metrics(self):
+        """Publish the latency percentiles of every goal phase."""
+        self._metrics_pub.publish(String(data=self._metrics.snapshot(self._result_cache)))
+
+    def _get_metrics(self, request, response):
+        """Answer a request for the latency percentiles of every goal phase."""
+        response.success = True
+        response.message = self._metrics.snapshot(self._result_cache)
+        return response
+
+    def _is_moving_now(self, goal_handle):
+        """Check whether a play mode goal has been asked to move now."""
+        if goal_handle.request.analysis_mode:
+            return False
+        return goal_key(goal_handle) in self._interrupt_times
+
+    async def _wait_for_cancel_state(self, goal_handle):
+        """Wait until the action server has moved a goal asked to stop into the canceling state."""
+        # The cancel callback returns before the action server marks the goal as canceling, and
+        # finishing the goal before that makes the action server fail the transition
+        deadline = time.monotonic() + CANCEL_STATE_TIMEOUT
+        while not goal_handle.is_cancel_requested and time.monotonic() < deadline:
+            await asyncio.sleep(0.001)
+
+    async def _finish_interrupted(self, goal_handle):
+        """Finalize a goal whose search has been stopped by a cancel or abort."""
+        self._record_cancel_latency(goal_handle)
+
+        if not goal_handle.is_active:
+            self.get_logger().info("Goal aborted")
+            return FindBestMove.Result()
+
+        await self._wait_for_cancel_state(goal_handle)
+        goal_handle.canceled()
+        self.get_logger().info("Goal canceled")
+        return FindBestMove.Result()
+
+    async def execute_callback(self, goal_handle):
         """Execute the goal."""
+        result = await self._loop.run(self._execute(goal_handle))
+
+        # The action server sends the result as soon as this returns
+        timing = self._goal_timings.pop(goal_key(goal_handle), None)
+        if timing is not None:
+            timing.finish()
+        return result
+
+    async def _execute(self, goal_handle):
+        """Execute the goal on the engine event loop."""
         game_config = self._current_game_config
         if game_config is None:
             self.get_logger().error(
@@ -106,50 +793,187 @@ class ChessEngineActionServer(Node):
         remaining_times = goal_handle.request.time
 
         board = chess.Board(board_fen)
+        self._mark(goal_handle, "parse")
+
+        session, board = self._sessions.attach(board)
         limit = chess.engine.Limit(
             white_clock=remaining_times.white_time_left / 1000,
             black_clock=remaining_times.black_time_left / 1000,
             white_inc=game_config.time_increment / 1000,
             black_inc=game_config.time_increment / 1000,
         )
+        if not goal_handle.request.analysis_mode:
+            self._time_manager.start_move(session, board, limit)
+
+        # Speculation for this game is obsolete now, and depending on the policy, all of it has to
+        # make way if the goal would otherwise wait for an engine
+        preemption_policy = self.get_parameter("preemption_policy").value
+        self._speculator.preempt(session.game_id)
+        if self._pool.idle_count == 0 and preemption_policy != "none":
+            self._speculator.preempt_all()
+
+        # The opening book, the tablebases or an earlier or speculative search may already have
+        # answered this position
+        if not goal_handle.request.analysis_mode:
+            known_move = self._known_move(board, limit)
+            self._mark(goal_handle, "lookup")
+            if known_move is not None:
+                return await self._succeed_with_move(goal_handle, session, known_move)
+
+        # Wait for a free engine, play goals first and then the goal with the least time left
+        analysis_mode = goal_handle.request.analysis_mode
+        if not analysis_mode and self._pool.idle_count == 0 and preemption_policy == "analysis":
+            self._preempt_analysis()
+
+        def abandoned():
+            # A play goal asked to move now keeps waiting, and searches briefly once it has an
+            # engine
+            if analysis_mode:
+                return self._is_interrupted(goal_handle)
+            return not goal_handle.is_active
+
+        try:
+            worker = await self._pool.acquire(
+                board,
+                session.engine_index,
+                abandoned,
+                ANALYSIS_PRIORITY if analysis_mode else PLAY_PRIORITY,
+                time.monotonic() + self._estimate_move_time(board, limit),
+            )
+        except chess.engine.EngineTerminatedError as error:
+            self.get_logger().error(f"No engine available: {error}")
+            goal_handle.abort()
+            return FindBestMove.Result()
+        if worker is None:
+            self.get_logger().info("Goal interrupted while waiting for an engine")
+            return await self._finish_interrupted(goal_handle)
+
+        session.engine_index = worker.index
+
+        try:
+            return await self._execute_with_retries(worker, goal_handle, session, board, limit)
+        finally:
+            self._interrupt_times.pop(goal_key(goal_handle), None)
+            await self._pool.release(worker)
+
+    async def _execute_with_retries(self, worker, goal_handle, session, board, limit):
+        """
+        Execute the goal on an engine, retrying it if the engine crashes.
+
+        The pool respawns crashed engines. The retry searches with what is left of the clock, and
+        python-chess replays the game's moves to the new process. An engine killed by the watchdog
+        is only searched again if there is no fallback move.
+        """
+        for retry in range(ENGINE_CRASH_RETRIES + 1):
+            engine = worker.engine
+            start = time.monotonic()
+            # Analysis searches are sent the goal's clock, and play searches move the deadline to
+            # their own limit once it is known
+            deadline = self._search_deadline(board, limit)
+            watchdog = Watchdog(worker, deadline, WATCHDOG_STOP_TIMEOUT, self.get_logger())
+            try:
+                return await self._execute_on(worker, goal_handle, session, board, limit, watchdog)
+            except chess.engine.EngineTerminatedError:
+                # A hung engine has used up the goal's time budget, and a goal asked to move now
+                # should not wait for a respawn, so rather than searching again, fall back to any
+                # move at hand
+                if watchdog.fired or self._is_moving_now(goal_handle):
+                    fallback_move = self._fallback_move(board, limit, watchdog)
+                    if fallback_move is not None:
+                        self.get_logger().warning(f"Falling back to {fallback_move.uci()}")
+                        return await self._succeed_with_move(goal_handle, session, fallback_move)
+                if retry == ENGINE_CRASH_RETRIES:
+                    break
+                self.get_logger().error(f"Engine {worker.index} crashed during the search")
+            finally:
+                watchdog.cancel()
+
+            worker.crashed(engine)
+            try:
+                await worker.wait_running()
+            except chess.engine.EngineTerminatedError:
+                break
+            # A play goal asked to move now is searched briefly on the respawned engine instead
+            if self._is_interrupted(goal_handle) and not self._is_moving_now(goal_handle):
+                return await self._finish_interrupted(goal_handle)
+
+            limit = self._deduct_time(board, limit, time.monotonic() - start)
+            self.get_logger().info(f"Retrying the goal on the restarted engine {worker.index}")
+
+        self.get_logger().error(f"Engine {worker.index} keeps crashing, aborting the goal")
+        self._interrupt_times.pop(goal_key(goal_handle), None)
+        goal_handle.abort()
+        return FindBestMove.Result()
+
+    async def _execute_on(self, worker, goal_handle, session, board, limit, watchdog):
+        """Execute the goal on an engine taken from the pool, under the watch of `watchdog`."""
+        # Any running ponder search has to be stopped before the engine can take a new command
+        ponder_hit = await worker.stop_pondering(board)
 
         # Analysis mode allows cancellation but not drawing or resigning
         if goal_handle.request.analysis_mode:
             self.get_logger().info("Executing in analysis mode")
-            analysis = self._engine.analysis(board, limit=limit)
-            while True:
-                # Check if the goal has been aborted
-                if not goal_handle.is_active:
-                    self.get_logger().info("Goal aborted")
-                    return FindBestMove.Result()
-
-                # Check if the goal has been cancelled
-                if goal_handle.is_cancel_requested:
-                    goal_handle.canceled()
-                    self.get_logger().info("Goal canceled")
-                    return FindBestMove.Result()
-
-                # Wait for the next info from the engine and break if a move is found
-                info = analysis.next()
-                if info is None:
-                    break
+            self._mark(goal_handle, "dispatch")
+            start = time.monotonic()
+            # One MultiPV search ranks as many candidates as asked for, and the result is the best
+            multipv = self.get_parameter("analysis_multipv").value
+            analysis = await worker.engine.analysis(
+                board,
+                limit=limit,
+                multipv=multipv if multipv > 1 else None,
+                game=session.game_id,
+            )
+            feedback = FeedbackAggregator(
+                goal_handle, self.get_clock(), self.get_parameter("feedback_rate").value, multipv
+            )
+
+            # Cancel requests stop the search directly, which ends the loop as soon as the engine
+            # sends its best move
+            self._searches[goal_key(goal_handle)] = analysis.stop
+            self._analysis_searches[goal_key(goal_handle)] = (
+                start + self._estimate_move_time(board, limit),
+                analysis.stop,
+            )
+            first_info = True
+            try:
+                while not self._is_interrupted(goal_handle):
+                    # Wait for the next info from the engine and break if a move is found
+                    try:
+                        info = await analysis.get()
+                    except chess.engine.AnalysisComplete:
+                        break
+                    if first_info:
+                        self._mark(goal_handle, "first_info")
+                        first_info = False
 
-                # Send feedback to the client
-                for key, value in info.items():
-                    feedback_result = FindBestMove.Feedback()
-                    feedback_result.info.timestamp = self.get_clock().now().to_msg()
-                    feedback_result.info.type = key
-                    feedback_result.info.value = str(value)
-                    goal_handle.publish_feedback(feedback_result)
+                    # Send feedback to the client
+                    feedback.update(info)
+                    watchdog.seen(info)
+            except chess.engine.EngineTerminatedError:
+                feedback.discard()
+                raise
+            finally:
+                del self._searches[goal_key(goal_handle)]
+                self._analysis_searches.pop(goal_key(goal_handle), None)
 
-            # Send the result to the client
-            engine_move = analysis.wait().move
+            if self._is_interrupted(goal_handle):
+                feedback.discard()
+                await self._stop_analysis(analysis)
+                return await self._finish_interrupted(goal_handle)
+
+            # Send the final PV and then the result to the client
+            feedback.flush()
+            engine_move = (await analysis.wait()).move
+            self._mark(goal_handle, "bestmove")
             if engine_move is None:
                 self.get_logger().error("No move found")
                 goal_handle.abort()
                 return FindBestMove.Result()
             else:
                 self.get_logger().info("Found best move")
+                self._store_result(
+                    board, limit, engine_move, analysis.info, time.monotonic() - start
+                )
                 goal_handle.succeed()
                 result = FindBestMove.Result()
                 result.move.move = engine_move.uci()
@@ -157,10 +981,25 @@ class ChessEngineActionServer(Node):
                 result.move.resign = False
                 return result
 
-        # Play mode allows drawing and resigning, but not cancellation
+        # Play mode allows drawing and resigning. Cancellation makes the engine move now.
         else:
             self.get_logger().info("Executing in play mode")
-            engine_result = self._engine.play(board, limit=limit)
+            self._mark(goal_handle, "dispatch")
+            start = time.monotonic()
+            full_search = ponder_hit is None
+            engine_result = await self._play(
+                worker, goal_handle, session, board, limit, ponder_hit, watchdog
+            )
+            self._mark(goal_handle, "bestmove")
+
+            if not goal_handle.is_active:
+                self.get_logger().info("Goal aborted")
+                return FindBestMove.Result()
+            moved_now = self._is_moving_now(goal_handle)
+            if moved_now:
+                full_search = False
+            self._record_cancel_latency(goal_handle)
+
             result = FindBestMove.Result()
 
             if engine_result.draw_offered:
@@ -179,16 +1018,248 @@ class ChessEngineActionServer(Node):
                 return FindBestMove.Result()
 
             self.get_logger().info("Move found")
+            if full_search and engine_result.move is not None:
+                self._store_result(
+                    board, limit, engine_result.move, engine_result.info, time.monotonic() - start
+                )
+            if moved_now:
+                await self._wait_for_cancel_state(goal_handle)
             goal_handle.succeed()
+            session.record_move(engine_result.move)
+
+            pondering = (
+                self.get_parameter("ponder").value
+                and engine_result.move is not None
+                and engine_result.ponder is not None
+            )
+            if pondering:
+                # The goal has already succeeded, so pondering is only attempted on a best-effort
+                # basis. The pool respawns an engine that died in the meantime.
+                try:
+                    await worker.start_pondering(
+                        board, engine_result.move, engine_result.ponder, session.game_id
+                    )
+                except chess.engine.EngineTerminatedError:
+                    self.get_logger().warning(f"Engine {worker.index} died before pondering")
+                    pondering = False
+
+            # The predicted reply is already covered by pondering, so speculate on the others
+            replies = self.get_parameter("speculation_replies").value
+            if replies > 0 and engine_result.move is not None:
+                speculation_board = board.copy()
+                speculation_board.push(engine_result.move)
+                if not speculation_board.is_game_over():
+                    self._speculator.start(
+                        speculation_board,
+                        session.game_id,
+                        self._own_clock(board, limit)[0],
+                        replies,
+                        self.get_parameter("speculation_time").value,
+                        exclude=engine_result.ponder if pondering else None,
+                        engine_index=session.engine_index,
+                        reserved_indices=self._sessions.engine_indices(session.game_id),
+                    )
+
             return result
 
+    def _preempt_analysis(self):
+        """
+        Cut the analysis search with the latest deadline short, to free its engine for a play goal.
+
+        The analysis goal still succeeds, with the best move found so far.
+        """
+        if not self._analysis_searches:
+            return
+        key = max(self._analysis_searches, key=lambda key: self._analysis_searches[key][0])
+        _, stop = self._analysis_searches.pop(key)
+        self.get_logger().info("Preempting an analysis goal for a play goal")
+        stop()
+
+    def _known_move(self, board, limit):
+        """Look a move for `board` up in the opening book, the tablebases or the result cache."""
+        book_move = self._book.move(board) if self._book is not None else None
+        if book_move is not None:
+            self.get_logger().info("Found a book move")
+            return book_move
+
+        tablebase_move = self._tablebase.best_move(board) if self._tablebase is not None else None
+        if tablebase_move is not None:
+            self.get_logger().info("Found a tablebase move")
+            return tablebase_move
+
+        cached = self._cached_move(board, limit)
+        if cached is not None:
+            self.get_logger().info(f"Found a cached move searched to depth {cached.depth}")
+            return cached.move
+        return None
+
+    def _cached_move(self, board, limit):
+        """Get a cached move for `board` that is about as good as a search under `limit`."""
+        cached = self._result_cache.get(board, self._own_clock(board, limit)[0])
+        if cached is None or not board.is_legal(cached.move):
+            return None
+
+        # Until there are enough searches to estimate their depth, compare the time spent instead
+        budget = self._estimate_move_time(board, limit)
+        expected_depth = self._depth_estimator.expected_depth(budget)
+        if expected_depth is None:
+            return cached if cached.time >= budget else None
+        return cached if cached.depth >= expected_depth else None
+
+    def _search_deadline(self, board, limit):
+        """
+        Get the number of seconds after which a search under `limit` is considered hung.
+
+        `limit` must be the limit the engine is actually sent, as a fixed time is much shorter than
+        what an engine may spend out of a whole clock.
+        """
+        grace = self.get_parameter("watchdog_grace").value
+        if limit.time is not None:
+            return limit.time + grace
+        clock, inc = self._own_clock(board, limit)
+        if clock is None:
+            # Depth limited searches, like when asked to move now, are expected to be quick
+            return grace
+        return min(clock, clock * MAX_CLOCK_FRACTION + (inc or 0.0)) + grace
+
+    def _fallback_move(self, board, limit, watchdog):
+        """
+        Find a move for a goal whose engine hung.
+
+        The best move the search printed is preferred, then a cached move however shallow, then a
+        book move.
+        """
+        if watchdog.best_move is not None and board.is_legal(watchdog.best_move):
+            return watchdog.best_move
+
+        cached = self._result_cache.get(board, self._own_clock(board, limit)[0])
+        if cached is not None and board.is_legal(cached.move):
+            return cached.move
+
+        if self._book is not None:
+            return self._book.move(board)
+        return None
+
+    def _store_result(self, board, limit, move, info, search_time):
+        """Cache the result of a finished search and learn from the depth it reached."""
+        depth = info.get("depth", 0)
+        self._depth_estimator.record(search_time, depth)
+        self._result_cache.put(
+            board,
+            self._own_clock(board, limit)[0],
+            CachedMove(move, info.get("score"), depth, search_time),
+        )
+
+    async def _succeed_with_move(self, goal_handle, session, move):
+        """
+        Finish a goal with a move found without searching.
+
+        Only a play mode goal's move is recorded as played, as an analysis mode goal's never is.
+        """
+        result = FindBestMove.Result()
+        result.move.move = move.uci()
+        result.move.draw = False
+        result.move.resign = False
+
+        # A goal asked to move now is answered right away, which ends its cancel latency too
+        if goal_key(goal_handle) in self._interrupt_times:
+            self._record_cancel_latency(goal_handle)
+            await self._wait_for_cancel_state(goal_handle)
+        goal_handle.succeed()
+        if not goal_handle.request.analysis_mode:
+            session.record_move(move)
+        return result
+
+    async def _play(self, worker, goal_handle, session, board, limit, ponder_hit, watchdog):
+        """
+        Search for a move in play mode, reusing the ponder search on a ponder hit.
+
+        The search runs as an analysis, whose `stop` python-chess holds back until `go` has been
+        sent. A raw `stop` would be lost while the engine is still busy with `ucinewgame`, and the
+        search would then run its full time.
+        """
+        search_limit = self._time_manager.search_limit(board, limit)
+        if goal_key(goal_handle) in self._interrupt_times:
+            self.get_logger().info("Asked to move before the search started")
+            search_limit = chess.engine.Limit(depth=1)
+            ponder_hit = None
+
+        if ponder_hit is not None:
+            ponder_move, pondered_time = ponder_hit
+            remaining_time = self._estimate_move_time(board, limit) - pondered_time
+            if remaining_time <= 0 and ponder_move is not None:
+                self.get_logger().info(f"Ponder hit after {pondered_time:.2f}s, moving instantly")
+                return chess.engine.PlayResult(ponder_move, None)
+
+            # The engine's hash is already filled with the ponder search, so only top it up
+            self.get_logger().info(
+                f"Ponder hit after {pondered_time:.2f}s, searching the remainder"
+            )
+            search_limit = chess.engine.Limit(time=max(remaining_time, 0.0))
+
+        # Unlike `play`, `analysis` turns the engine's analysis mode on unless told otherwise
+        options = {}
+        if "UCI_AnalyseMode" in worker.engine.options:
+            options = {"UCI_AnalyseMode": self._pool.options.get("UCI_AnalyseMode", False)}
+
+        watchdog.restart(self._search_deadline(board, search_limit))
+        analysis = await worker.engine.analysis(
+            board, search_limit, game=session.game_id, info=SEARCH_INFO, options=options
+        )
+        key = goal_key(goal_handle)
+        self._searches[key] = analysis.stop
+        first_info = True
+        try:
+            # Moving now may have been asked for while the search was being started
+            if key in self._interrupt_times:
+                analysis.stop()
+            async for info in analysis:
+                if first_info:
+                    self._mark(goal_handle, "first_info")
+                    first_info = False
+                watchdog.seen(info)
+            best = await analysis.wait()
+        finally:
+            del self._searches[key]
+        return chess.engine.PlayResult(best.move, best.ponder, analysis.info)
+
+    async def _stop_analysis(self, analysis):
+        """Stop an analysis search and wait for the engine to become idle."""
+        analysis.stop()
+        await analysis.wait()
+
+    def _deduct_time(self, board, limit, elapsed):
+        """Take the time spent so far off the clock of the side to move."""
+        if board.turn == chess.WHITE:
+            return dataclasses.replace(limit, white_clock=max(limit.white_clock - elapsed, 0.0))
+        return dataclasses.replace(limit, black_clock=max(limit.black_clock - elapsed, 0.0))
+
+    def _own_clock(self, board, limit):
+        """Get the remaining time and increment of the side to move, in seconds."""
+        return own_clock(board.turn, limit)
+
+    def _estimate_move_time(self, board, limit):
+        """Estimate how long the engine would spend on a move under a clock limit."""
+        return self._time_manager.move_time(*self._own_clock(board, limit))
+
 
 def main(args=None):
     rclpy.init(args=args)
 
     action_server = ChessEngineActionServer()
 
-    rclpy.spin(action_server)
+    # Searches run on the engine event loop, so the executor threads only have to keep up with
+    # goal intake, cancellation, feedback and configuration updates
+    threads = action_server.get_parameter("executor_threads").value
+    if threads > 1:
+        executor = MultiThreadedExecutor(num_threads=threads)
+    else:
+        executor = SingleThreadedExecutor()
+    executor.add_node(action_server)
+    try:
+        executor.spin()
+    finally:
+        executor.shutdown()
 
     # Destroy the node explicitly
     # (optional - otherwise it will be done automatically
@@ -0,0 +1,501 @@
+import asyncio
+import collections
+import dataclasses
+import itertools
+import math
+import time
+
+import chess
+import chess.engine
+
+from chess_controller.placement import Placement
+
+# How often a queued goal checks whether it has been abandoned while waiting for an engine
+ACQUIRE_POLL_INTERVAL = 0.1
+
+# Priorities of the goals waiting for an engine, most urgent first. Speculative searches rank
+# below both, as they never wait for an engine at all.
+PLAY_PRIORITY = 0
+ANALYSIS_PRIORITY = 1
+
+# Game of the warm-up searches, so the first real game starts with `ucinewgame`
+WARM_UP_GAME = "warm-up"
+
+# Delay before the second restart of an engine within the restart window, doubled for every further
+# restart. The first restart is immediate.
+RESTART_BACKOFF = 0.1
+MAX_RESTART_BACKOFF = 5.0
+
+
+@dataclasses.dataclass
+class RestartPolicy:
+    """How often a crashed engine is respawned before the pool gives up on it."""
+
+    max_restarts: int = 5
+    window: float = 300.0
+
+    def delay(self, restarts, now):
+        """
+        Get the delay before the next restart, or `None` to give up.
+
+        `restarts` holds the times of the engine's earlier restarts, and is pruned to the window.
+        """
+        while restarts and now - restarts[0] > self.window:
+            restarts.popleft()
+        if len(restarts) >= self.max_restarts:
+            return None
+        if not restarts:
+            return 0.0
+        return min(RESTART_BACKOFF * 2 ** (len(restarts) - 1), MAX_RESTART_BACKOFF)
+
+
+class EngineWorker:
+    """
+    A chess engine process together with the ponder search running on it.
+
+    The worker outlives its process: when the process crashes, the pool respawns it and swaps the
+    new process in.
+    """
+
+    def __init__(self, index, transport, engine, logger, placement):
+        self.index = index
+        self.transport = transport
+        self.engine = engine
+        self.placement = placement
+        self._logger = logger
+
+        # Option changes to apply the next time the engine is not searching
+        self.pending_options = {}
+
+        # Set while the process is running, and once the pool gave up on respawning it
+        self._running = asyncio.Event()
+        self._running.set()
+        self.failed = False
+
+        # Background search on the position we expect after the opponent's reply
+        self._ponder_analysis = None
+        self._ponder_board = None
+        self._ponder_start = 0.0
+
+    @property
+    def is_pondering(self):
+        """Whether a ponder search is running on this engine."""
+        return self._ponder_analysis is not None
+
+    def is_pondering_on(self, board):
+        """Check whether this engine is pondering on the position of `board`."""
+        return self._ponder_board is not None and self._ponder_board.epd() == board.epd()
+
+    @property
+    def is_running(self):
+        """Whether the engine process is running."""
+        return self._running.is_set() and not self.failed
+
+    async def wait_running(self):
+        """
+        Wait until the engine process is running, if it is being respawned.
+
+        Raises `EngineTerminatedError` if the pool gave up on respawning it.
+        """
+        await self._running.wait()
+        if self.failed:
+            raise chess.engine.EngineTerminatedError(f"Engine {self.index} could not be restarted")
+
+    def crashed(self, engine):
+        """Mark the engine as being respawned, unless `engine` has already been replaced."""
+        if engine is not self.engine:
+            return
+        self._running.clear()
+        self._ponder_analysis = None
+        self._ponder_board = None
+
+    def restarted(self, transport, engine):
+        """Swap in a respawned engine process."""
+        self.transport = transport
+        self.engine = engine
+        self.pending_options = {}
+        self._running.set()
+
+    def fail(self):
+        """Give up on the engine, failing everyone waiting for it."""
+        self.failed = True
+        self._running.set()
+
+    async def start_pondering(self, board, move, ponder_move, game=None):
+        """Start searching the position after our move and the expected reply."""
+        ponder_board = board.copy()
+        ponder_board.push(move)
+        if not ponder_board.is_legal(ponder_move):
+            return
+        ponder_board.push(ponder_move)
+        if ponder_board.is_game_over():
+            return
+
+        self._logger.info(f"Engine {self.index} pondering on {ponder_move.uci()}")
+        self._ponder_board = ponder_board
+        self._ponder_start = time.monotonic()
+        self._ponder_analysis = await self.engine.analysis(ponder_board, game=game)
+
+    async def stop_pondering(self, board=None):
+        """
+        Stop the ponder search, if any.
+
+        Returns the ponder search's best move and its duration if `board` is the position that was
+        pondered on, otherwise `None`.
+        """
+        if self._ponder_analysis is None:
+            return None
+
+        analysis, ponder_board = self._ponder_analysis, self._ponder_board
+        self._ponder_analysis = None
+        self._ponder_board = None
+
+        pondered_time = time.monotonic() - self._ponder_start
+        analysis.stop()
+        ponder_move = (await analysis.wait()).move
+
+        if board is None or ponder_board.epd() != board.epd():
+            self._logger.info(f"Engine {self.index} ponder miss")
+            return None
+        return ponder_move, pondered_time
+
+    async def apply_pending_options(self):
+        """Apply the pending option changes and wait until the engine is ready again."""
+        if not self.pending_options:
+            return
+
+        options, self.pending_options = self.pending_options, {}
+        await self.stop_pondering()
+        await self.engine.configure(options)
+        await self.engine.ping()
+        self._logger.info(f"Engine {self.index} reconfigured: {options}")
+
+    async def close(self):
+        """Stop any ponder search and shut the engine process down."""
+        if not self.is_running:
+            return
+        await self.stop_pondering()
+        await self.engine.quit()
+
+
+class EnginePool:
+    """
+    A fixed set of engine processes shared between goals.
+
+    Every engine is spawned, configured and confirmed ready with `isready` up front. Goals wait for
+    an idle engine in order of priority, then earliest deadline, then arrival, so play goals go
+    before analysis goals and the goal that needs its answer first goes first. Goals with far
+    deadlines can therefore wait for as long as goals with nearer ones keep arriving. Engines whose
+    process exits are respawned with the same options, following the restart policy. All
+    coroutines must be run on the engine event loop.
+    """
+
+    def __init__(self, workers, options, logger, engine_path, env=None, restart_policy=None):
+        self._logger = logger
+        self._workers = workers
+        self._options = dict(options)
+        self._engine_path = engine_path
+        self._env = env
+        self._restart_policy = restart_policy or RestartPolicy()
+
+        self._condition = asyncio.Condition()
+        self._idle = list(workers)
+        self._waiting = []
+        self._arrivals = itertools.count()
+
+        self._closed = False
+        self._supervisors = [asyncio.ensure_future(self._supervise(worker)) for worker in workers]
+
+    @classmethod
+    async def start(
+        cls, engine_path, size, options, logger, placements=None, env=None, restart_policy=None
+    ):
+        """
+        Spawn `size` engines in parallel and wait until all of them are ready to search.
+
+        Engine `i` runs with `placements[i]`, if given, and every engine with the environment
+        `env`, if given.
+        """
+        placements = placements or [Placement() for _ in range(size)]
+        processes = await asyncio.gather(
+            *(
+                cls._spawn(index, engine_path, options, logger, placements[index], env)
+                for index in range(size)
+            )
+        )
+        workers = [
+            EngineWorker(index, transport, engine, logger, placements[index])
+            for index, (transport, engine) in enumerate(processes)
+        ]
+        return cls(workers, options, logger, engine_path, env, restart_policy)
+
+    @staticmethod
+    async def _spawn(index, engine_path, options, logger, placement, env):
+        """Start an engine process with its placement and wait until it is ready to search."""
+        transport, engine = await chess.engine.popen_uci(placement.command(engine_path), env=env)
+
+        # Placed before configuring, so the search threads the engine starts inherit the placement
+        pid = transport.get_pid()
+        for error in placement.apply(pid):
+            logger.warning(f"Engine {index} could not be placed: {error}")
+
+        await engine.configure({key: val for key, val in options.items() if key in engine.options})
+        await engine.ping()
+
+        for mismatch in placement.verify(pid):
+            logger.warning(f"Engine {index} is not placed as configured: {mismatch}")
+        return transport, engine
+
+    async def _supervise(self, worker):
+        """Respawn an engine whenever its process exits, until the restart policy gives up."""
+        restarts = collections.deque()
+        while True:
+            engine = worker.engine
+            returncode = await engine.returncode
+            if self._closed:
+                return
+
+            exited_at = time.monotonic()
+            worker.crashed(engine)
+            self._logger.error(f"Engine {worker.index} exited with code {returncode}")
+
+            while True:
+                delay = self._restart_policy.delay(restarts, time.monotonic())
+                if delay is None:
+                    self._logger.error(
+                        f"Engine {worker.index} crashed {len(restarts)} times within "
+                        f"{self._restart_policy.window:.0f}s, giving up on it"
+                    )
+                    await self._retire(worker)
+                    return
+
+                await asyncio.sleep(delay)
+                restarts.append(time.monotonic())
+                try:
+                    transport, engine = await self._spawn(
+                        worker.index,
+                        self._engine_path,
+                        self._options,
+                        self._logger,
+                        worker.placement,
+                        self._env,
+                    )
+                    break
+                except (OSError, chess.engine.EngineError) as error:
+                    self._logger.error(f"Engine {worker.index} could not be restarted: {error}")
+
+            worker.restarted(transport, engine)
+            self._logger.info(
+                f"Engine {worker.index} restarted after "
+                f"{(time.monotonic() - exited_at) * 1000:.0f}ms"
+            )
+
+    async def _retire(self, worker):
+        """Take an engine that could not be respawned out of the pool for good."""
+        worker.fail()
+        async with self._condition:
+            if worker in self._idle:
+                self._idle.remove(worker)
+            self._condition.notify_all()
+
+    @property
+    def size(self):
+        """The number of engine processes in the pool."""
+        return len(self._workers)
+
+    @property
+    def workers(self):
+        """Every engine of the pool, busy or not."""
+        return list(self._workers)
+
+    @property
+    def engine_options(self):
+        """The UCI options the engines advertise, by name."""
+        return self._workers[0].engine.options
+
+    @property
+    def options(self):
+        """The values of the options that have been set on the engines."""
+        return dict(self._options)
+
+    @property
+    def idle_count(self):
+        """The number of engines not searching for a goal, including those pondering."""
+        return len(self._idle)
+
+    @property
+    def queue_depth(self):
+        """The number of goals currently waiting for an engine. Safe to read from any thread."""
+        return len(self._waiting)
+
+    async def acquire(
+        self,
+        board,
+        preferred_index=None,
+        abandoned=lambda: False,
+        priority=PLAY_PRIORITY,
+        deadline=math.inf,
+    ):
+        """
+        Wait for an idle engine to search `board`.
+
+        Waiting goals are served by `priority`, then by `deadline` (a `time.monotonic` time). An
+        engine pondering on `board` is preferred, then the engine at `preferred_index` (the one
+        whose hash already holds the game), then engines that are not pondering at all. Returns
+        `None` if `abandoned()` becomes true while waiting. Raises `EngineTerminatedError` if every
+        engine has crashed for good.
+        """
+        ticket = (priority, deadline, next(self._arrivals))
+        while True:
+            worker = await self._wait_for_idle(ticket, board, preferred_index, abandoned)
+            if worker is None:
+                return None
+
+            engine = worker.engine
+            try:
+                await worker.wait_running()
+                await worker.apply_pending_options()
+                return worker
+            except chess.engine.EngineTerminatedError:
+                # The engine died while being reconfigured, or was given up on while being
+                # respawned. The goal keeps its place in the queue and waits for the respawn or
+                # another engine.
+                if not worker.failed:
+                    worker.crashed(engine)
+                await self.release(worker)
+
+    async def _wait_for_idle(self, ticket, board, preferred_index, abandoned):
+        """Wait until `ticket` is first in the queue and take the idle engine best suited to it."""
+        async with self._condition:
+            self._waiting.append(ticket)
+            try:
+                while min(self._waiting) != ticket or not self._idle:
+                    if abandoned():
+                        return None
+                    if all(worker.failed for worker in self._workers):
+                        raise chess.engine.EngineTerminatedError("Every engine has crashed")
+                    try:
+                        await asyncio.wait_for(self._condition.wait(), ACQUIRE_POLL_INTERVAL)
+                    except asyncio.TimeoutError:
+                        pass
+
+                worker = self._choose(board, preferred_index)
+                self._idle.remove(worker)
+                return worker
+            finally:
+                self._waiting.remove(ticket)
+                self._condition.notify_all()
+
+    async def try_acquire(self, preferred_index=None, reserved_indices=()):
+        """
+        Take an idle engine that is not pondering, for background work.
+
+        The engine at `preferred_index` is preferred. Engines at `reserved_indices`, whose hash
+        holds other games, are only taken if they are the preferred one, as searching another game
+        on them makes python-chess send `ucinewgame` and the engine clear its hash. Returns `None`
+        instead of waiting if there is no such engine or a goal is waiting for one.
+        """
+        async with self._condition:
+            if self._waiting:
+                return None
+            candidates = [
+                worker
+                for worker in self._idle
+                if worker.is_running
+                and not worker.is_pondering
+                and (worker.index == preferred_index or worker.index not in reserved_indices)
+            ]
+            if not candidates:
+                return None
+            worker = next(
+                (worker for worker in candidates if worker.index == preferred_index),
+                candidates[0],
+            )
+            self._idle.remove(worker)
+
+        engine = worker.engine
+        try:
+            await worker.apply_pending_options()
+        except chess.engine.EngineTerminatedError:
+            worker.crashed(engine)
+            await self.release(worker)
+            return None
+        return worker
+
+    def _choose(self, board, preferred_index):
+        """Pick the idle engine best suited to search `board`."""
+        for worker in self._idle:
+            if worker.is_pondering_on(board):
+                return worker
+
+        # Engines being respawned only if there is nothing else
+        candidates = [worker for worker in self._idle if worker.is_running] or self._idle
+        for worker in candidates:
+            if worker.index == preferred_index:
+                return worker
+        for worker in candidates:
+            if not worker.is_pondering:
+                return worker
+        return candidates[0]
+
+    async def warm_up(self, search_time):
+        """
+        Run a short search on every engine, so the first goal does not pay for cold caches.
+
+        Also makes sure every engine has applied its options, loaded its network and allocated its
+        hash table.
+        """
+        board = chess.Board()
+        limit = chess.engine.Limit(time=search_time)
+        await asyncio.gather(
+            *(worker.engine.play(board, limit, game=WARM_UP_GAME) for worker in self._workers)
+        )
+        await asyncio.gather(*(worker.engine.ping() for worker in self._workers))
+
+    async def configure(self, options):
+        """
+        Change engine options.
+
+        Engines that are not busy are reconfigured right away, the others as soon as they are done
+        with their current goal. Idle engines are taken out of the pool while they are
+        reconfigured, so no goal can start a search on them halfway through. Raises the first error
+        an engine reported, once every engine is back in the pool.
+        """
+        self._options.update(options)
+        for worker in self._workers:
+            worker.pending_options.update(options)
+
+        async with self._condition:
+            workers = [
+                worker for worker in self._idle if worker.is_running and not worker.is_pondering
+            ]
+            for worker in workers:
+                self._idle.remove(worker)
+
+        results = await asyncio.gather(
+            *(worker.apply_pending_options() for worker in workers), return_exceptions=True
+        )
+        for worker in workers:
+            await self.release(worker)
+        for result in results:
+            if isinstance(result, BaseException):
+                raise result
+
+    async def wake(self):
+        """Make every waiting goal check right away whether it has been abandoned."""
+        async with self._condition:
+            self._condition.notify_all()
+
+    async def release(self, worker):
+        """Return an engine to the pool once a goal is done with it."""
+        async with self._condition:
+            if not worker.failed:
+                self._idle.append(worker)
+            self._condition.notify_all()
+
+    async def close(self):
+        """Shut down every engine process."""
+        self._closed = True
+        await asyncio.gather(*(worker.close() for worker in self._workers), return_exceptions=True)
+        for supervisor in self._supervisors:
+            supervisor.cancel()
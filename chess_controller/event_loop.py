@@ -0,0 +1,59 @@
+import asyncio
+import threading
+
+
+class LoopFuture:
+    """
+    Awaitable result of a coroutine running on an `EventLoopThread`.
+
+    Awaiting it from an rclpy coroutine callback yields back to the rclpy executor until the result
+    is ready, so the executor thread stays free for other callbacks in the meantime.
+    """
+
+    def __init__(self, future):
+        self._future = future
+
+    def __await__(self):
+        while not self._future.done():
+            yield
+        return self._future.result()
+
+
+class EventLoopThread:
+    """
+    A single asyncio event loop, running on its own thread, that drives every engine.
+
+    python-chess's `SimpleEngine` runs a separate event loop thread per engine and blocks the
+    calling thread on every command. Running all engine protocols on one loop instead lets any
+    number of searches and cancellations be in flight at once without a thread per goal.
+    """
+
+    def __init__(self, wake):
+        # Called from the loop thread whenever a result becomes ready, to wake the rclpy executor
+        self._wake = wake
+
+        self.loop = asyncio.new_event_loop()
+        self._thread = threading.Thread(
+            target=self.loop.run_forever, name="chess_engine_loop", daemon=True
+        )
+        self._thread.start()
+
+    def run(self, coro):
+        """Schedule `coro` on the loop and return an awaitable for its result."""
+        future = asyncio.run_coroutine_threadsafe(coro, self.loop)
+        future.add_done_callback(lambda _: self._wake())
+        return LoopFuture(future)
+
+    def run_sync(self, coro):
+        """Run `coro` on the loop and block until it is done."""
+        return asyncio.run_coroutine_threadsafe(coro, self.loop).result()
+
+    def call_soon(self, callback, *args):
+        """Call `callback` on the loop thread as soon as possible."""
+        self.loop.call_soon_threadsafe(callback, *args)
+
+    def close(self):
+        """Stop the loop and wait for its thread to finish."""
+        self.loop.call_soon_threadsafe(self.loop.stop)
+        self._thread.join()
+        self.loop.close()
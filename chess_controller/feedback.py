@@ -0,0 +1,121 @@
+import asyncio
+import json
+import time
+
+import chess
+import chess.engine
+
+from chess_msgs.action import FindBestMove
+
+# Feedback type of the coalesced engine info, whose value is a JSON object keyed by info field
+INFO_FEEDBACK_TYPE = "info"
+
+
+def _color_name(color):
+    """Name a color the way FENs and UCI would, in lower case."""
+    return "white" if color == chess.WHITE else "black"
+
+
+def _encode_value(value):
+    """Convert a value of a python-chess info dict to its JSON equivalent."""
+    if isinstance(value, chess.engine.PovScore):
+        score = value.relative
+        return {"cp": score.score(), "mate": score.mate(), "pov": _color_name(value.turn)}
+    if isinstance(value, chess.engine.PovWdl):
+        wdl = value.relative
+        return {
+            "wins": wdl.wins,
+            "draws": wdl.draws,
+            "losses": wdl.losses,
+            "pov": _color_name(value.turn),
+        }
+    if isinstance(value, chess.Move):
+        return value.uci()
+    if isinstance(value, list):
+        return [_encode_value(item) for item in value]
+    if isinstance(value, dict):
+        return {_encode_key(key): _encode_value(item) for key, item in value.items()}
+    if isinstance(value, (bool, int, float, str)) or value is None:
+        return value
+    return str(value)
+
+
+def _encode_key(key):
+    """Convert a key of a nested python-chess info value (a move or CPU number) to a JSON key."""
+    return key.uci() if isinstance(key, chess.Move) else str(key)
+
+
+def encode_info(info):
+    """
+    Convert a python-chess info dict to a JSON-ready dict with typed values.
+
+    Counters stay numbers, the score becomes `{"cp", "mate", "pov"}` from the point of view of the
+    side to move, and moves and lines become UCI strings and arrays of UCI strings.
+    """
+    return {key: _encode_value(value) for key, value in info.items()}
+
+
+class FeedbackAggregator:
+    """
+    Coalesces engine info lines into at most one feedback message per interval.
+
+    Engines can print hundreds of info lines per second. Only the latest value of every field is
+    kept between messages, so the feedback bandwidth stays bounded however fast the engine runs.
+    For a MultiPV search, every message holds the latest info of all lines, ranked. Must be used on
+    the engine event loop.
+    """
+
+    def __init__(self, goal_handle, clock, rate, multipv=1):
+        self._goal_handle = goal_handle
+        self._clock = clock
+        self._interval = 1.0 / rate if rate > 0 else 0.0
+        self._multipv = multipv
+
+        self._pending = {}
+
+        # Latest info of every line of a MultiPV search, by rank
+        self._lines = {}
+        self._last_publish = 0.0
+        self._flush_handle = None
+
+    def update(self, info):
+        """Add an info line from the engine, publishing it once the interval has passed."""
+        self._pending.update(info)
+        if self._multipv > 1:
+            self._lines.setdefault(info.get("multipv", 1), {}).update(info)
+        if self._flush_handle is not None:
+            return
+
+        delay = self._last_publish + self._interval - time.monotonic()
+        if delay <= 0:
+            self.flush()
+        else:
+            self._flush_handle = asyncio.get_running_loop().call_later(delay, self.flush)
+
+    def flush(self):
+        """Publish the pending info right away."""
+        if self._flush_handle is not None:
+            self._flush_handle.cancel()
+            self._flush_handle = None
+        if not self._pending:
+            return
+
+        feedback = FindBestMove.Feedback()
+        feedback.info.timestamp = self._clock.now().to_msg()
+        feedback.info.type = INFO_FEEDBACK_TYPE
+        if self._multipv > 1:
+            value = {"lines": [encode_info(self._lines[rank]) for rank in sorted(self._lines)]}
+        else:
+            value = encode_info(self._pending)
+        feedback.info.value = json.dumps(value)
+        self._goal_handle.publish_feedback(feedback)
+
+        self._pending.clear()
+        self._last_publish = time.monotonic()
+
+    def discard(self):
+        """Drop the pending info without publishing it."""
+        if self._flush_handle is not None:
+            self._flush_handle.cancel()
+            self._flush_handle = None
+        self._pending.clear()
@@ -0,0 +1,83 @@
+import os
+import resource
+
+# Large page modes, by parameter value, with the glibc malloc tunable enabling them
+LARGE_PAGE_MODES = {
+    "transparent": "glibc.malloc.hugetlb=1",
+    "explicit": "glibc.malloc.hugetlb=2",
+}
+
+TRANSPARENT_HUGEPAGE_ENABLED = "/sys/kernel/mm/transparent_hugepage/enabled"
+
+
+def transparent_huge_pages():
+    """Get the kernel's transparent huge page mode (`always`, `madvise` or `never`), if any."""
+    try:
+        with open(TRANSPARENT_HUGEPAGE_ENABLED) as file:
+            text = file.read()
+    except OSError:
+        return None
+    start, end = text.find("["), text.find("]")
+    return text[start + 1:end] if start >= 0 and end > start else None
+
+
+def free_huge_pages():
+    """Get the memory in the kernel's pool of explicit huge pages that is still free, in bytes."""
+    fields = _read_fields("/proc/meminfo")
+    return fields.get("HugePages_Free", 0) * fields.get("Hugepagesize", 0) * 1024
+
+
+def engine_environment(mode):
+    """
+    Build the environment of an engine allocating its memory from large pages.
+
+    The glibc malloc tunables make the engine's large allocations, like its hash table, use
+    transparent huge pages or pages from the kernel's explicit huge page pool, without any support
+    from the engine itself.
+    """
+    env = dict(os.environ)
+    tunables = [tunable for tunable in env.get("GLIBC_TUNABLES", "").split(":") if tunable]
+    tunables.append(LARGE_PAGE_MODES[mode])
+    env["GLIBC_TUNABLES"] = ":".join(tunables)
+    return env
+
+
+def raise_memlock_limit():
+    """
+    Raise the locked memory limit of this process, and of the engines it starts, to the maximum.
+
+    Returns the new soft limit in bytes, or `None` if there is no limit.
+    """
+    try:
+        resource.setrlimit(
+            resource.RLIMIT_MEMLOCK, (resource.RLIM_INFINITY, resource.RLIM_INFINITY)
+        )
+    except (ValueError, OSError):
+        # Without CAP_SYS_RESOURCE the soft limit can only go up to the hard limit
+        _, hard = resource.getrlimit(resource.RLIMIT_MEMLOCK)
+        resource.setrlimit(resource.RLIMIT_MEMLOCK, (hard, hard))
+    limit, _ = resource.getrlimit(resource.RLIMIT_MEMLOCK)
+    return None if limit == resource.RLIM_INFINITY else limit
+
+
+def huge_page_usage(pid):
+    """Get the memory of a process backed by transparent and explicit huge pages, in bytes."""
+    fields = _read_fields(f"/proc/{pid}/smaps_rollup")
+    transparent = fields.get("AnonHugePages", 0) * 1024
+    explicit = (fields.get("Shared_Hugetlb", 0) + fields.get("Private_Hugetlb", 0)) * 1024
+    return transparent, explicit
+
+
+def _read_fields(path):
+    """Read the `Name: value kB` lines of a file under `/proc` into a dict of numbers."""
+    fields = {}
+    try:
+        with open(path) as file:
+            for line in file:
+                name, _, value = line.partition(":")
+                value = value.split()
+                if value and value[0].isdigit():
+                    fields[name.strip()] = int(value[0])
+    except OSError:
+        pass
+    return fields
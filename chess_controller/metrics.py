@@ -0,0 +1,86 @@
+import json
+import time
+
+# Number of most recent samples kept per latency
+LATENCY_SAMPLES = 1000
+
+# Phases of a goal, in order. Each one's latency runs from the end of the previous one.
+GOAL_PHASES = ("accept", "parse", "lookup", "dispatch", "first_info", "bestmove", "result")
+
+# Percentiles reported for every latency
+REPORTED_PERCENTILES = (0.5, 0.9, 0.99)
+
+
+class LatencyRecorder:
+    """
+    Keeps the most recent samples of one latency and summarises them as percentiles.
+
+    Samples are written into a ring buffer without locking, so recording from the executor and the
+    engine event loop threads never blocks either of them.
+    """
+
+    def __init__(self, capacity=LATENCY_SAMPLES):
+        self._samples = [0.0] * capacity
+        self._count = 0
+
+    def record(self, seconds):
+        """Add a sample, in seconds."""
+        self._samples[self._count % len(self._samples)] = seconds
+        self._count += 1
+
+    def percentile(self, fraction):
+        """Get the given percentile of the recorded samples, or `None` if there are none."""
+        samples = sorted(self._samples[: min(self._count, len(self._samples))])
+        if not samples:
+            return None
+        return samples[min(int(fraction * len(samples)), len(samples) - 1)]
+
+    def summary(self):
+        """Summarise the recorded samples as a JSON-ready dict of percentiles in milliseconds."""
+        summary = {"count": self._count}
+        for fraction in REPORTED_PERCENTILES:
+            value = self.percentile(fraction)
+            summary[f"p{fraction * 100:g}"] = value * 1000 if value is not None else None
+        return summary
+
+
+class GoalMetrics:
+    """The latency of every phase of the goals, from their arrival to their result being sent."""
+
+    def __init__(self):
+        self.phases = {phase: LatencyRecorder() for phase in GOAL_PHASES + ("total",)}
+        self.cancel = LatencyRecorder()
+
+    def start(self, received):
+        """Start timing a goal that arrived at `received`, on the `time.perf_counter` clock."""
+        return GoalTiming(self, received)
+
+    def snapshot(self, result_cache=None):
+        """Summarise every latency, and the lookups in `result_cache` if given, as JSON."""
+        snapshot = {
+            "phases": {phase: recorder.summary() for phase, recorder in self.phases.items()},
+            "cancel": self.cancel.summary(),
+        }
+        if result_cache is not None:
+            snapshot["result_cache"] = result_cache.summary()
+        return json.dumps(snapshot)
+
+
+class GoalTiming:
+    """Marks the end of each phase of one goal, recording the phase's latency."""
+
+    def __init__(self, metrics, received):
+        self._metrics = metrics
+        self._received = received
+        self._last = received
+
+    def mark(self, phase):
+        """Record that `phase` has just ended."""
+        now = time.perf_counter()
+        self._metrics.phases[phase].record(now - self._last)
+        self._last = now
+
+    def finish(self):
+        """Record that the goal's result has been sent, ending the goal."""
+        self.mark("result")
+        self._metrics.phases["total"].record(self._last - self._received)
@@ -0,0 +1,241 @@
+import os
+import random
+import sys
+import threading
+import time
+
+import chess
+
+# Options of the mock engine as (UCI type, default, minimum, maximum), by name. The behaviour
+# options default to the environment variable named after them, like `MOCK_ENGINE_THINK_TIME`.
+OPTIONS = {
+    "Threads": ("spin", 1, 1, 512),
+    "Hash": ("spin", 16, 1, 33554432),
+    "MultiPV": ("spin", 1, 1, 500),
+    "Ponder": ("check", False, None, None),
+    "Think Time": ("spin", 0, 0, 3600000),
+    "Info Rate": ("spin", 10, 0, 1000),
+    "Crash After": ("spin", 0, 0, 1000000),
+    "Hang After": ("spin", 0, 0, 1000000),
+}
+
+# Number of moves a clock is assumed to be spread over, like real engines do
+EXPECTED_MOVES_TO_GO = 30
+
+# Simulated time per ply of a depth limited search
+DEPTH_TIME = 0.01
+
+
+def _environment_name(option):
+    """Get the environment variable holding the default of a behaviour option."""
+    return "MOCK_ENGINE_" + option.upper().replace(" ", "_")
+
+
+class MockEngine:
+    """
+    A fake UCI engine for exercising and benchmarking the node without a real engine.
+
+    It "searches" by sleeping for the time the `go` limits or the `Think Time` option give, prints
+    info lines with made-up scores and random legal lines at `Info Rate` per second, and answers
+    with a random legal move. `Crash After` and `Hang After` make it exit or stop answering on
+    that search, to test crash recovery and the watchdog. `isready` and `stop` are answered while
+    searching, like a real engine.
+    """
+
+    def __init__(self, output=sys.stdout):
+        self._output = output
+        self._output_lock = threading.Lock()
+        self._random = random.Random(0)
+
+        self.options = {name: default for name, (_, default, _, _) in OPTIONS.items()}
+        for name in OPTIONS:
+            if _environment_name(name) in os.environ:
+                self.options[name] = int(os.environ[_environment_name(name)])
+
+        self._board = chess.Board()
+        self._searches = 0
+        self._hanging = False
+        self._stop_requested = threading.Event()
+        self._search_thread = None
+
+    def send(self, line):
+        """Print a line to the GUI."""
+        with self._output_lock:
+            self._output.write(line + "\n")
+            self._output.flush()
+
+    def run(self, lines):
+        """Answer UCI commands until `quit` or the end of the input."""
+        handlers = {
+            "uci": self._uci,
+            "isready": self._isready,
+            "setoption": self._setoption,
+            "ucinewgame": self._ucinewgame,
+            "position": self._position,
+            "go": self._go,
+            "stop": self._stop,
+            "ponderhit": self._ponderhit,
+        }
+        for line in lines:
+            command, _, arguments = line.strip().partition(" ")
+            if command == "quit":
+                break
+            if command in handlers:
+                handlers[command](arguments)
+        if not self._hanging:
+            self._stop_search()
+
+    def _uci(self, arguments):
+        self.send("id name Mock Engine")
+        self.send("id author chess_controller")
+        for name, (kind, default, minimum, maximum) in OPTIONS.items():
+            if kind == "spin":
+                self.send(
+                    f"option name {name} type spin default {default} min {minimum} max {maximum}"
+                )
+            else:
+                self.send(f"option name {name} type check default {str(default).lower()}")
+        self.send("uciok")
+
+    def _isready(self, arguments):
+        self.send("readyok")
+
+    def _setoption(self, arguments):
+        name, _, value = arguments.removeprefix("name ").partition(" value ")
+        if name not in OPTIONS:
+            return
+        kind = OPTIONS[name][0]
+        self.options[name] = value == "true" if kind == "check" else int(value)
+
+    def _ucinewgame(self, arguments):
+        self._board = chess.Board()
+
+    def _position(self, arguments):
+        position, _, moves = arguments.partition("moves")
+        position = position.strip()
+        if position == "startpos":
+            board = chess.Board()
+        else:
+            board = chess.Board(position.removeprefix("fen ").strip())
+        for move in moves.split():
+            board.push_uci(move)
+        self._board = board
+
+    def _go(self, arguments):
+        self._stop_search()
+        self._searches += 1
+
+        if self.options["Crash After"] and self._searches >= self.options["Crash After"]:
+            # Like a segfault, without a word to the GUI
+            os._exit(1)
+
+        self._stop_requested.clear()
+        self._search_thread = threading.Thread(
+            target=self._search,
+            args=(self._board.copy(), self._search_time(arguments.split())),
+            daemon=True,
+        )
+        self._search_thread.start()
+
+    def _stop(self, arguments):
+        self._stop_requested.set()
+
+    def _ponderhit(self, arguments):
+        pass
+
+    def _search_time(self, arguments):
+        """Get how long to search for the arguments of `go`, or `None` until `stop`."""
+        if self.options["Think Time"]:
+            return self.options["Think Time"] / 1000
+        if "infinite" in arguments or "ponder" in arguments:
+            return None
+
+        values = {}
+        for name, value in zip(arguments, arguments[1:]):
+            if value.lstrip("-").isdigit():
+                values[name] = int(value)
+        if "movetime" in values:
+            return values["movetime"] / 1000
+        if "depth" in values:
+            return values["depth"] * DEPTH_TIME
+
+        side = "w" if self._board.turn == chess.WHITE else "b"
+        if f"{side}time" in values:
+            clock = values[f"{side}time"] / 1000
+            return clock / EXPECTED_MOVES_TO_GO + values.get(f"{side}inc", 0) / 1000
+        return None
+
+    def _search(self, board, search_time):
+        """Pretend to search `board` for `search_time` seconds, or until stopped."""
+        if self.options["Hang After"] and self._searches >= self.options["Hang After"]:
+            # Never answer, however often the GUI sends `stop`
+            self._hanging = True
+            threading.Event().wait()
+
+        start = time.monotonic()
+        interval = 1.0 / self.options["Info Rate"] if self.options["Info Rate"] else None
+        depth = 0
+
+        lines = self._lines(board)
+        while True:
+            elapsed = time.monotonic() - start
+            remaining = None if search_time is None else search_time - elapsed
+            if remaining is not None and remaining <= 0:
+                break
+
+            timeout = interval if remaining is None else min(interval or remaining, remaining)
+            if self._stop_requested.wait(timeout):
+                break
+
+            if interval is not None and lines:
+                depth += 1
+                self._send_info(lines, depth, time.monotonic() - start)
+
+        if not lines:
+            self.send("bestmove (none)")
+        elif len(lines[0]) > 1:
+            self.send(f"bestmove {lines[0][0].uci()} ponder {lines[0][1].uci()}")
+        else:
+            self.send(f"bestmove {lines[0][0].uci()}")
+
+    def _lines(self, board):
+        """Make up the principal variations of a search, one per `MultiPV`."""
+        moves = list(board.legal_moves)
+        self._random.shuffle(moves)
+
+        lines = []
+        for move in moves[: self.options["MultiPV"]]:
+            line = [move]
+            board.push(move)
+            replies = list(board.legal_moves)
+            if replies:
+                line.append(self._random.choice(replies))
+            board.pop()
+            lines.append(line)
+        return lines
+
+    def _send_info(self, lines, depth, elapsed):
+        """Print one info line per principal variation."""
+        nodes = int(elapsed * 1000000)
+        for rank, line in enumerate(lines, 1):
+            score = self._random.randint(-100, 100)
+            pv = " ".join(move.uci() for move in line)
+            self.send(
+                f"info depth {depth} multipv {rank} score cp {score} nodes {nodes} "
+                f"nps 1000000 time {int(elapsed * 1000)} pv {pv}"
+            )
+
+    def _stop_search(self):
+        """Stop the search in progress, if any, and wait for its best move."""
+        if self._search_thread is not None:
+            self._stop_requested.set()
+            self._search_thread.join()
+            self._search_thread = None
+
+
+def main():
+    MockEngine().run(sys.stdin)
+
+
+if __name__ == "__main__":
+    main()
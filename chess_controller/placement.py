@@ -0,0 +1,140 @@
+import dataclasses
+import os
+import shutil
+
+# Scheduling policies engines may run under, by parameter value
+SCHEDULING_POLICIES = {
+    "other": os.SCHED_OTHER,
+    "batch": os.SCHED_BATCH,
+    "idle": os.SCHED_IDLE,
+}
+
+
+def parse_cpu_list(text):
+    """Parse a CPU list in the kernel's format, like `0-3,8,10-11`, into a set of CPU numbers."""
+    cpus = set()
+    for part in text.split(","):
+        part = part.strip()
+        if not part:
+            continue
+        first, _, last = part.partition("-")
+        cpus.update(range(int(first), int(last or first) + 1))
+    return cpus
+
+
+def numa_node_cpus(node):
+    """Get the CPUs of a NUMA node."""
+    with open(f"/sys/devices/system/node/node{node}/cpulist") as file:
+        return parse_cpu_list(file.read())
+
+
+def _split(text):
+    """Split a `;`-separated per-engine parameter, ignoring empty entries."""
+    return [part.strip() for part in text.split(";") if part.strip()]
+
+
+@dataclasses.dataclass
+class Placement:
+    """The CPUs, NUMA node and scheduling priority one engine process runs with."""
+
+    cpus: set = None
+    numa_node: int = None
+    policy: str = None
+    nice: int = 0
+
+    @classmethod
+    def for_pool(cls, size, cpu_lists, numa_nodes, policy, nice):
+        """
+        Build the placement of every engine of a pool.
+
+        `cpu_lists` and `numa_nodes` hold one `;`-separated entry per engine, and are repeated if
+        they have fewer entries than the pool has engines. An empty `policy` and a `nice` of 0
+        leave the engines with the node's own scheduling policy and nice value.
+        """
+        policy = policy or None
+        if policy is not None and policy not in SCHEDULING_POLICIES:
+            raise ValueError(f"Unknown scheduling policy '{policy}'")
+
+        cpu_sets = [parse_cpu_list(cpus) for cpus in _split(cpu_lists)]
+        nodes = [int(node) for node in _split(numa_nodes)]
+        return [
+            cls(
+                cpu_sets[index % len(cpu_sets)] if cpu_sets else None,
+                nodes[index % len(nodes)] if nodes else None,
+                policy,
+                nice,
+            )
+            for index in range(size)
+        ]
+
+    @property
+    def allowed_cpus(self):
+        """The CPUs the engine may run on, or `None` if it inherits the node's affinity."""
+        if self.numa_node is None:
+            return self.cpus
+        node_cpus = numa_node_cpus(self.numa_node)
+        return node_cpus if self.cpus is None else self.cpus & node_cpus
+
+    def command(self, engine_path):
+        """
+        Get the command starting the engine.
+
+        Engines bound to a NUMA node are started through `numactl`, when it is installed, so their
+        hash table is allocated on the node's memory as well.
+        """
+        if self.numa_node is not None and shutil.which("numactl"):
+            return ["numactl", f"--membind={self.numa_node}", engine_path]
+        return engine_path
+
+    def apply(self, pid):
+        """
+        Apply the placement to every thread of a running process.
+
+        Threads the engine starts later, like the search threads added by the `Threads` option,
+        inherit it from the main thread. Returns the errors of the settings that could not be
+        applied.
+        """
+        errors = []
+        cpus = self.allowed_cpus
+        for tid in _threads(pid):
+            try:
+                if cpus is not None:
+                    os.sched_setaffinity(tid, cpus)
+                if self.policy is not None:
+                    policy = SCHEDULING_POLICIES[self.policy]
+                    os.sched_setscheduler(tid, policy, os.sched_param(0))
+                if self.nice:
+                    os.setpriority(os.PRIO_PROCESS, tid, self.nice)
+            except OSError as error:
+                errors.append(f"thread {tid}: {error}")
+        return errors
+
+    def verify(self, pid):
+        """Check every thread of a running process against the placement, listing mismatches."""
+        mismatches = []
+        cpus = self.allowed_cpus
+        policy = SCHEDULING_POLICIES.get(self.policy)
+        for tid in _threads(pid):
+            try:
+                actual_cpus = os.sched_getaffinity(tid)
+                actual_policy = os.sched_getscheduler(tid)
+                actual_nice = os.getpriority(os.PRIO_PROCESS, tid)
+            except OSError:
+                # The thread exited in the meantime
+                continue
+
+            if cpus is not None and actual_cpus != cpus:
+                mismatches.append(f"thread {tid} runs on CPUs {sorted(actual_cpus)}")
+            if policy is not None and actual_policy != policy:
+                mismatches.append(f"thread {tid} has scheduling policy {actual_policy}")
+            if self.nice and actual_nice != self.nice:
+                mismatches.append(f"thread {tid} has nice value {actual_nice}")
+        return mismatches
+
+
+def _threads(pid):
+    """List the thread IDs of a process."""
+    try:
+        return [int(tid) for tid in os.listdir(f"/proc/{pid}/task")]
+    except OSError:
+        return [pid]
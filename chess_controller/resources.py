@@ -0,0 +1,75 @@
+import math
+import os
+
+CGROUP_ROOT = "/sys/fs/cgroup"
+
+
+def _read(path):
+    """Read a small text file, or return `None` if it cannot be read."""
+    try:
+        with open(path) as file:
+            return file.read().strip()
+    except OSError:
+        return None
+
+
+def _cgroup_dir():
+    """Find the cgroup v2 directory of this process."""
+    for line in (_read("/proc/self/cgroup") or "").splitlines():
+        if line.startswith("0::"):
+            directory = os.path.join(CGROUP_ROOT, line[3:].lstrip("/"))
+            if os.path.isdir(directory):
+                return directory
+    return CGROUP_ROOT
+
+
+def available_cpus():
+    """
+    Count the CPUs this process may use.
+
+    This is the smaller of the CPUs in the affinity mask and the cgroup v2 CPU quota (`cpu.max`),
+    rounded up.
+    """
+    cpus = len(os.sched_getaffinity(0))
+
+    cpu_max = _read(os.path.join(_cgroup_dir(), "cpu.max"))
+    if cpu_max is not None:
+        quota, _, period = cpu_max.partition(" ")
+        if quota != "max" and period:
+            cpus = min(cpus, max(1, math.ceil(int(quota) / int(period))))
+    return cpus
+
+
+def available_memory():
+    """
+    Get the memory this process may use, in bytes.
+
+    This is the smaller of the cgroup v2 memory limit (`memory.max`) and the machine's total memory
+    from `/proc/meminfo`.
+    """
+    memory = None
+    for line in (_read("/proc/meminfo") or "").splitlines():
+        if line.startswith("MemTotal:"):
+            memory = int(line.split()[1]) * 1024
+
+    memory_max = _read(os.path.join(_cgroup_dir(), "memory.max"))
+    if memory_max is not None and memory_max != "max":
+        memory = int(memory_max) if memory is None else min(memory, int(memory_max))
+    return memory
+
+
+def engine_sizes(pool_size, cpus, memory, reserved_cpus, hash_fraction):
+    """
+    Split CPUs and memory between the engines of a pool.
+
+    Returns the `Threads` and `Hash` (in MB, rounded down to a power of two) of each engine, after
+    setting `reserved_cpus` aside for the rest of the system and giving the engines `hash_fraction`
+    of the memory.
+    """
+    threads = max(1, (cpus - reserved_cpus) // pool_size)
+
+    hash_mb = 16
+    if memory is not None:
+        hash_mb = max(1, int(memory * hash_fraction / pool_size) // 2**20)
+        hash_mb = 2 ** int(math.log2(hash_mb))
+    return threads, hash_mb
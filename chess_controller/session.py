@@ -0,0 +1,198 @@
+import itertools
+import threading
+import time
+
+import chess
+
+# How many of the opponent's and our own moves may be missing between two goals of one game
+MAX_NEW_PLIES = 2
+
+# How many moves may be taken back between two goals of one game
+MAX_TAKEBACK_PLIES = 4
+
+# Most squares one move empties or fills, which castling does
+MAX_SQUARES_PER_PLY = 4
+
+
+def same_position(board, other):
+    """Check whether two boards hold the same position, ignoring the move counters."""
+    return board.occupied == other.occupied and board.epd() == other.epd()
+
+
+def within_plies(board, target, plies):
+    """
+    Check cheaply whether `target` could be `plies` moves or fewer away from `board`.
+
+    Every move empties or fills at most four squares and removes at most one piece, so positions
+    further apart than that are ruled out without generating any moves.
+    """
+    changed = chess.popcount(board.occupied ^ target.occupied)
+    captured = chess.popcount(board.occupied) - chess.popcount(target.occupied)
+    return changed <= MAX_SQUARES_PER_PLY * plies and 0 <= captured <= plies
+
+
+class GameSession:
+    """The move history of one game, kept across the goals that belong to it."""
+
+    def __init__(self, game_id, board):
+        self.game_id = game_id
+        self.board = board
+        self.last_move = None
+        self.engine_index = None
+        self.last_used = time.monotonic()
+
+        # When we last answered a play mode goal, and our clock when that goal arrived
+        self.moved_at = None
+        self.clock_reading = None
+
+    def record_move(self, move):
+        """Record the move we answered a play mode goal with."""
+        self.last_move = move
+        self.moved_at = time.monotonic()
+
+    def moves_to(self, target):
+        """
+        Find the moves that lead from the session's position to `target`.
+
+        Returns `None` if `target` is not within reach of the session's position.
+        """
+        if same_position(self.board, target):
+            return []
+        return self._search(self.board.copy(), target, MAX_NEW_PLIES, self.last_move)
+
+    def _search(self, board, target, depth, likely_move=None):
+        """
+        Search `depth` plies deep for the moves leading from `board` to `target`.
+
+        `likely_move` is tried first: the move we returned last is by far the most likely one to
+        have been played.
+        """
+        if not within_plies(board, target, depth):
+            return None
+
+        # The last move has to leave a square that is empty in `target` for one that is not.
+        # python-chess applies the target mask to the castling rook's square, which is empty after
+        # castling, so castling moves are generated separately.
+        if depth > 1:
+            moves = list(board.legal_moves)
+        else:
+            vacated = board.occupied & ~target.occupied
+            moves = list(board.generate_legal_moves(from_mask=vacated, to_mask=target.occupied))
+            moves += [
+                move
+                for move in board.generate_castling_moves(from_mask=vacated)
+                if move not in moves and board.is_legal(move)
+            ]
+        if likely_move in moves:
+            moves.remove(likely_move)
+            moves.insert(0, likely_move)
+
+        for move in moves:
+            board.push(move)
+            try:
+                if same_position(board, target):
+                    return [move]
+                if depth > 1:
+                    line = self._search(board, target, depth - 1)
+                    if line is not None:
+                        return [move] + line
+            finally:
+                board.pop()
+        return None
+
+    def plies_taken_back_to(self, target):
+        """
+        Find how many moves have to be taken back to reach `target`.
+
+        Returns `None` if `target` is not among the session's recent positions.
+        """
+        board = self.board.copy()
+        for plies in range(1, min(MAX_TAKEBACK_PLIES, len(board.move_stack)) + 1):
+            board.pop()
+            if same_position(board, target):
+                return plies
+        return None
+
+
+class SessionManager:
+    """
+    Tracks the games being played so each goal can be searched with its full move history.
+
+    Goals do not name the game they belong to, so the game is recognised by diffing the goal's
+    position against the position of every live session. Sessions that have not been used for
+    `ttl` seconds are dropped, and so is the least recently used one when there are more than
+    `max_sessions`.
+    """
+
+    def __init__(self, ttl, logger, max_sessions=32):
+        self._ttl = ttl
+        self._max_sessions = max_sessions
+        self._logger = logger
+        self._lock = threading.Lock()
+        self._sessions = {}
+        self._game_ids = (f"game-{number}" for number in itertools.count(1))
+
+    def attach(self, board):
+        """
+        Find the session `board` belongs to and bring it up to date, or start a new one.
+
+        The session's board ends up at the position of `board`, with the moves leading there on its
+        move stack. Returns the session and a copy of its board to search on.
+        """
+        with self._lock:
+            now = time.monotonic()
+            self._evict(now)
+
+            session = self._catch_up(board) or self._take_back(board)
+            if session is None:
+                session = GameSession(next(self._game_ids), board.copy())
+                self._sessions[session.game_id] = session
+                self._logger.info(f"Started session {session.game_id}")
+                self._evict_least_recently_used()
+
+            session.last_used = now
+            return session, session.board.copy()
+
+    def engine_indices(self, excluded_game_id=None):
+        """Get the engines that last searched the live games other than `excluded_game_id`."""
+        with self._lock:
+            return {
+                session.engine_index
+                for session in self._sessions.values()
+                if session.game_id != excluded_game_id and session.engine_index is not None
+            }
+
+    def _catch_up(self, board):
+        """Apply the moves played since the last goal to the session `board` belongs to."""
+        for session in self._sessions.values():
+            moves = session.moves_to(board)
+            if moves is not None:
+                for move in moves:
+                    session.board.push(move)
+                return session
+        return None
+
+    def _take_back(self, board):
+        """Undo the moves taken back since the last goal in the session `board` belongs to."""
+        for session in self._sessions.values():
+            plies = session.plies_taken_back_to(board)
+            if plies is not None:
+                self._logger.info(f"Taking back {plies} plies in session {session.game_id}")
+                for _ in range(plies):
+                    session.board.pop()
+                return session
+        return None
+
+    def _evict(self, now):
+        """Drop the sessions that have been idle for longer than the TTL."""
+        for game_id, session in list(self._sessions.items()):
+            if now - session.last_used > self._ttl:
+                self._logger.info(f"Dropping idle session {game_id}")
+                del self._sessions[game_id]
+
+    def _evict_least_recently_used(self):
+        """Drop the sessions used longest ago until there are no more than the maximum."""
+        while len(self._sessions) > self._max_sessions:
+            game_id = min(self._sessions, key=lambda game_id: self._sessions[game_id].last_used)
+            self._logger.info(f"Dropping session {game_id}, too many games are in progress")
+            del self._sessions[game_id]
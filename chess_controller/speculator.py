@@ -0,0 +1,159 @@
+import asyncio
+import time
+
+import chess.engine
+
+from chess_controller.cache import CachedMove
+
+
+class _Speculation:
+    """The state of the speculation for one game."""
+
+    def __init__(self):
+        self.stopped = False
+        self.stop_search = None
+
+    def stop(self):
+        """Stop the speculation, including the search in progress."""
+        self.stopped = True
+        if self.stop_search is not None:
+            self.stop_search()
+
+
+class Speculator:
+    """
+    Searches our replies to the opponent's most likely moves while the opponent is thinking.
+
+    After we move, a short MultiPV search of the opponent's options picks their most likely
+    replies, and the position after each of them is searched ahead of time on an otherwise idle
+    engine. The results go to the result cache, so a goal for one of those positions can be
+    answered without searching. Speculation never waits for an engine, and is stopped as soon as a
+    real goal needs one. It runs on the game's own engine if that is idle, and never on an engine
+    whose hash holds another game. Must be used on the engine event loop.
+    """
+
+    def __init__(self, pool, cache, logger):
+        self._pool = pool
+        self._cache = cache
+        self._logger = logger
+
+        # Speculation in progress by game
+        self._speculations = {}
+
+    def start(
+        self,
+        board,
+        game,
+        clock,
+        replies,
+        search_time,
+        exclude=None,
+        engine_index=None,
+        reserved_indices=(),
+    ):
+        """
+        Speculate on the opponent's `replies` most likely replies in the position of `board`.
+
+        `clock` is our remaining time, which the results are cached under. `engine_index` is the
+        engine that last searched the game, and `reserved_indices` the engines that last searched
+        other games.
+        """
+        self.preempt(game)
+        speculation = _Speculation()
+        self._speculations[game] = speculation
+        asyncio.ensure_future(
+            self._speculate(
+                speculation,
+                board,
+                game,
+                clock,
+                replies,
+                search_time,
+                exclude,
+                engine_index,
+                reserved_indices,
+            )
+        )
+
+    def preempt(self, game):
+        """Stop speculating for a game."""
+        speculation = self._speculations.pop(game, None)
+        if speculation is not None:
+            speculation.stop()
+
+    def preempt_all(self):
+        """Stop speculating for every game, freeing the engines for real goals."""
+        for game in list(self._speculations):
+            self.preempt(game)
+
+    async def _speculate(
+        self,
+        speculation,
+        board,
+        game,
+        clock,
+        replies,
+        search_time,
+        exclude,
+        engine_index,
+        reserved_indices,
+    ):
+        """Search the opponent's likely replies one after another on an idle engine."""
+        worker = await self._pool.try_acquire(engine_index, reserved_indices)
+        if worker is None:
+            return
+
+        try:
+            moves = await self._likely_replies(
+                speculation, worker, board, game, replies, search_time
+            )
+            for move in moves:
+                if speculation.stopped:
+                    return
+                if move == exclude:
+                    continue
+                reply_board = board.copy()
+                reply_board.push(move)
+                if reply_board.is_game_over():
+                    continue
+
+                start = time.monotonic()
+                analysis = await self._search(speculation, worker, reply_board, game, search_time)
+                if not speculation.stopped and analysis.info.get("pv"):
+                    self._cache.put(
+                        reply_board,
+                        clock,
+                        CachedMove(
+                            analysis.info["pv"][0],
+                            analysis.info.get("score"),
+                            analysis.info.get("depth", 0),
+                            time.monotonic() - start,
+                        ),
+                    )
+                    self._logger.info(f"Speculated on {move.uci()} in {game}")
+        except chess.engine.EngineTerminatedError:
+            # The pool respawns the engine, and speculation is only worth it on a healthy one
+            self._logger.warning(f"Engine {worker.index} died while speculating in {game}")
+        finally:
+            if self._speculations.get(game) is speculation:
+                del self._speculations[game]
+            await self._pool.release(worker)
+
+    async def _likely_replies(self, speculation, worker, board, game, replies, search_time):
+        """Rank the opponent's moves with a short MultiPV search."""
+        analysis = await self._search(speculation, worker, board, game, search_time / 2, replies)
+        return [info["pv"][0] for info in analysis.multipv if info.get("pv")]
+
+    async def _search(self, speculation, worker, board, game, search_time, multipv=None):
+        """Run a fixed-time search that can be stopped early, and wait for it to finish."""
+        analysis = await worker.engine.analysis(
+            board, chess.engine.Limit(time=search_time), multipv=multipv, game=game
+        )
+        speculation.stop_search = analysis.stop
+        if speculation.stopped:
+            analysis.stop()
+        try:
+            await analysis.wait()
+        finally:
+            speculation.stop_search = None
+        return analysis
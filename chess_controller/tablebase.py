@@ -0,0 +1,64 @@
+import os
+
+import chess
+import chess.syzygy
+
+
+class Tablebase:
+    """
+    Syzygy endgame tablebases, probed in-process.
+
+    Positions with few enough pieces are answered with the move that wins fastest, or loses
+    slowest, in terms of distance to zeroing (DTZ), without involving an engine.
+    """
+
+    def __init__(self, path, max_pieces):
+        directories = [directory for directory in path.split(os.pathsep) if directory]
+        self._tablebase = chess.syzygy.open_tablebase(directories[0])
+        for directory in directories[1:]:
+            self._tablebase.add_directory(directory)
+        self._max_pieces = max_pieces
+
+    def best_move(self, board):
+        """Get the DTZ-optimal move in the position of `board`, or `None` if it is not covered."""
+        if chess.popcount(board.occupied) > self._max_pieces or board.castling_rights:
+            return None
+
+        board = board.copy(stack=False)
+        best_move, best_rank = None, None
+        for move in board.legal_moves:
+            board.push(move)
+            try:
+                if board.is_checkmate():
+                    return move
+                rank = self._rank(board)
+            except KeyError:
+                # A table is missing
+                return None
+            finally:
+                board.pop()
+
+            if best_rank is None or rank > best_rank:
+                best_move, best_rank = move, rank
+        return best_move
+
+    def _rank(self, board):
+        """Rank the move that led to `board` for the side that played it. Higher is better."""
+        if board.is_stalemate() or board.is_insufficient_material():
+            return 0, 0
+
+        # Both values are from the opponent's point of view
+        wdl = -self._tablebase.probe_wdl(board)
+        dtz = self._tablebase.probe_dtz(board)
+
+        # A capture or pawn move resets the DTZ count, and reaches zeroing right away
+        plies = 1 if board.halfmove_clock == 0 else abs(dtz) + 1
+        if wdl > 0:
+            return wdl, -plies
+        if wdl < 0:
+            return wdl, plies
+        return 0, 0
+
+    def close(self):
+        """Close the table files."""
+        self._tablebase.close()
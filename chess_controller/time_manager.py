@@ -0,0 +1,108 @@
+import dataclasses
+import time
+
+import chess
+import chess.engine
+
+# Number of moves a clock is assumed to be spread over when estimating the time per move
+EXPECTED_MOVES_TO_GO = 30
+
+# Shortest search planned, however little time is left
+MIN_MOVE_TIME = 0.1
+
+# Time management modes, by parameter value
+TIME_MANAGEMENT_MODES = ("engine", "movetime")
+
+# Overhead samples beyond this many seconds are assumed to be clock mistakes, not motion
+MAX_OVERHEAD_SAMPLE = 60.0
+
+
+@dataclasses.dataclass
+class ClockReading:
+    """The clock of the side to move when a play mode goal of a session arrived."""
+
+    turn: bool
+    clock: float
+    inc: float
+    received: float
+
+
+def own_clock(turn, limit):
+    """Get the remaining time and increment of the side to move, in seconds."""
+    if turn == chess.WHITE:
+        return limit.white_clock, limit.white_inc
+    return limit.black_clock, limit.black_inc
+
+
+class TimeManager:
+    """
+    Plans play mode searches around the time the robot needs to carry out its moves.
+
+    The arm takes several seconds to make a move, and that time comes off our clock as well. The
+    overhead per move is learned from the clock deltas between the goals of a game: our clock at
+    one goal, minus the time we took to answer it, plus the increment, minus our clock at the next
+    goal. Searches are planned with that overhead and a fixed emergency reserve taken off the
+    clock, either as a fixed `movetime` or as adjusted clocks left to the engine's own time
+    management.
+    """
+
+    def __init__(self, mode, overhead, learning_rate, reserve, logger):
+        if mode not in TIME_MANAGEMENT_MODES:
+            raise ValueError(f"Unknown time management mode '{mode}'")
+        self._mode = mode
+        self._learning_rate = learning_rate
+        self._reserve = reserve
+        self._logger = logger
+
+        self.overhead = overhead
+
+    def start_move(self, session, board, limit):
+        """
+        Learn from the clock of a new play mode goal of `session`.
+
+        Must be called before the goal is answered, which is recorded with `session.record_move`.
+        """
+        clock, inc = own_clock(board.turn, limit)
+        previous = session.clock_reading
+        session.clock_reading = ClockReading(board.turn, clock, inc, time.monotonic())
+
+        # Only a reading from our previous move, which has been answered since, gives a sample
+        if previous is None or previous.turn != board.turn or session.moved_at is None:
+            return
+        if session.moved_at < previous.received or self._learning_rate <= 0:
+            return
+
+        answer_time = session.moved_at - previous.received
+        sample = previous.clock - answer_time + previous.inc - clock
+        if not 0.0 <= sample <= MAX_OVERHEAD_SAMPLE:
+            return
+
+        self.overhead += self._learning_rate * (sample - self.overhead)
+        self._logger.info(
+            f"Motion overhead {sample:.2f}s in {session.game_id}, estimate {self.overhead:.2f}s"
+        )
+
+    def move_time(self, clock, inc):
+        """Plan how long to search for a move, leaving time for the motion and the reserve."""
+        usable = max(clock - self._reserve, 0.0)
+        planned = usable / EXPECTED_MOVES_TO_GO + inc - self.overhead
+        return max(MIN_MOVE_TIME, min(planned, usable - self.overhead))
+
+    def search_limit(self, board, limit):
+        """
+        Convert a goal's clock limit into the limit the engine searches with.
+
+        In `engine` mode the side to move's clock and increment are scaled down, so the engine's
+        own time management arrives at about the planned move time. In `movetime` mode the engine
+        searches exactly the planned move time.
+        """
+        clock, inc = own_clock(board.turn, limit)
+        move_time = self.move_time(clock, inc)
+        if self._mode == "movetime":
+            return chess.engine.Limit(time=move_time)
+
+        engine_inc = max(inc - self.overhead, 0.0)
+        engine_clock = max((move_time - engine_inc) * EXPECTED_MOVES_TO_GO, move_time)
+        if board.turn == chess.WHITE:
+            return dataclasses.replace(limit, white_clock=engine_clock, white_inc=engine_inc)
+        return dataclasses.replace(limit, black_clock=engine_clock, black_inc=engine_inc)
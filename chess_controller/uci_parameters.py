@@ -0,0 +1,49 @@
+import re
+
+from rcl_interfaces.msg import IntegerRange, ParameterDescriptor
+
+# Prefix of the ROS parameters mirroring the engine's UCI options
+UCI_PARAMETER_PREFIX = "uci."
+
+
+def parameter_name(option):
+    """Get the name of the ROS parameter for a UCI option, e.g. `uci.Move_Overhead`."""
+    return UCI_PARAMETER_PREFIX + re.sub(r"[^A-Za-z0-9_]", "_", option.name)
+
+
+def is_exposed(option):
+    """
+    Check whether a UCI option can be set through a ROS parameter.
+
+    Buttons have no value, and python-chess sets the options it manages (such as `MultiPV` and
+    `Ponder`) itself for every search.
+    """
+    return option.type != "button" and not option.is_managed()
+
+
+def default_value(option):
+    """Get the engine's default for a UCI option as the type of its ROS parameter."""
+    if option.type == "check":
+        return bool(option.default)
+    if option.type == "spin":
+        return int(option.default) if option.default is not None else 0
+    return str(option.default) if option.default is not None else ""
+
+
+def descriptor(option):
+    """Describe the ROS parameter for a UCI option, including the range the engine accepts."""
+    description = ParameterDescriptor(description=f"Value of the engine's `{option.name}` option")
+    if option.type == "spin" and option.min is not None and option.max is not None:
+        description.integer_range = [
+            IntegerRange(from_value=int(option.min), to_value=int(option.max), step=1)
+        ]
+    elif option.type == "combo":
+        description.additional_constraints = "One of: " + ", ".join(option.var)
+    return description
+
+
+def validate(option, value):
+    """Check a new value for a UCI option's parameter, returning why it is invalid if it is."""
+    if option.type == "combo" and value not in option.var:
+        return f"`{value}` is not one of {', '.join(option.var)}"
+    return None
@@ -0,0 +1,50 @@
+import asyncio
+
+
+class Watchdog:
+    """
+    Stops, and if need be kills, an engine that overruns a goal's deadline.
+
+    At the deadline the engine is sent `stop`. If it still has not answered `stop_timeout` seconds
+    later, its process is killed, which makes the search in progress raise `EngineTerminatedError`
+    and the pool respawn the engine. Must be used on the engine event loop.
+    """
+
+    def __init__(self, worker, deadline, stop_timeout, logger):
+        self._worker = worker
+        self._stop_timeout = stop_timeout
+        self._logger = logger
+
+        # Whether the deadline has passed, and the best move of the searches seen so far
+        self.fired = False
+        self.best_move = None
+
+        self._handle = asyncio.get_running_loop().call_later(deadline, self._stop)
+
+    def seen(self, info):
+        """Remember the best move of an info line from the engine, as a fallback."""
+        if info.get("pv") and info.get("multipv", 1) == 1:
+            self.best_move = info["pv"][0]
+
+    def restart(self, deadline):
+        """Move the deadline to `deadline` seconds from now, unless it has already passed."""
+        if self.fired:
+            return
+        self._handle.cancel()
+        self._handle = asyncio.get_running_loop().call_later(deadline, self._stop)
+
+    def cancel(self):
+        """Stop watching, once the engine has answered."""
+        self._handle.cancel()
+
+    def _stop(self):
+        """Ask the engine to stop searching."""
+        self.fired = True
+        self._logger.warning(f"Engine {self._worker.index} overran its deadline, stopping it")
+        self._worker.engine.send_line("stop")
+        self._handle = asyncio.get_running_loop().call_later(self._stop_timeout, self._kill)
+
+    def _kill(self):
+        """Kill the engine process, which does not respond to `stop`."""
+        self._logger.error(f"Engine {self._worker.index} does not respond to stop, killing it")
+        self._worker.transport.kill()
@@ -18,6 +18,10 @@ setup(
     license="TODO: License declaration",
     tests_require=["pytest"],
     entry_points={
-        "console_scripts": ["chess_controller = chess_controller.chess_controller:main"],
+        "console_scripts": [
+            "chess_controller = chess_controller.chess_controller:main",
+            "mock_engine = chess_controller.mock_engine:main",
+            "benchmark = chess_controller.benchmark:main",
+        ],
     },
 )
@@ -0,0 +1,35 @@
+import sys
+
+import chess
+import chess.engine
+import pytest
+
+MOCK_ENGINE = [sys.executable, "-m", "chess_controller.mock_engine"]
+
+
+@pytest.fixture
+def engine():
+    engine = chess.engine.SimpleEngine.popen_uci(MOCK_ENGINE)
+    yield engine
+    engine.close()
+
+
+def test_mock_engine_plays_legal_moves(engine):
+    board = chess.Board()
+    for _ in range(4):
+        result = engine.play(board, chess.engine.Limit(time=0.05))
+        assert board.is_legal(result.move)
+        board.push(result.move)
+
+
+def test_mock_engine_reports_multipv(engine):
+    engine.configure({"Info Rate": 100})
+    infos = engine.analyse(chess.Board(), chess.engine.Limit(time=0.1), multipv=3)
+    assert len(infos) == 3
+    assert all(info["pv"] for info in infos)
+
+
+def test_mock_engine_crash_injection(engine):
+    engine.configure({"Crash After": 1})
+    with pytest.raises(chess.engine.EngineTerminatedError):
+        engine.play(chess.Board(), chess.engine.Limit(time=0.05))
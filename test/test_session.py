@@ -0,0 +1,95 @@
+import logging
+
+import chess
+
+from chess_controller.session import SessionManager
+
+LOGGER = logging.getLogger("test_session")
+
+
+def position(*moves):
+    """Get the board of a goal after `moves`, which like every goal has no move stack."""
+    board = chess.Board()
+    for move in moves:
+        board.push_san(move)
+    return chess.Board(board.fen())
+
+
+def uci(board):
+    return [move.uci() for move in board.move_stack]
+
+
+def test_attach_catches_up_with_new_moves():
+    sessions = SessionManager(600.0, LOGGER)
+    session, _ = sessions.attach(position("e4"))
+    session.record_move(chess.Move.from_uci("e7e5"))
+
+    caught_up, board = sessions.attach(position("e4", "e5", "Nf3"))
+    assert caught_up is session
+    assert uci(board) == ["e7e5", "g1f3"]
+    assert board.fen() == position("e4", "e5", "Nf3").fen()
+
+
+def test_attach_catches_up_with_the_opponent_castling():
+    sessions = SessionManager(600.0, LOGGER)
+    session, _ = sessions.attach(position("e4", "e5", "Nf3", "Nc6", "Bc4"))
+    session.record_move(chess.Move.from_uci("f8c5"))
+
+    caught_up, board = sessions.attach(position("e4", "e5", "Nf3", "Nc6", "Bc4", "Bc5", "O-O"))
+    assert caught_up is session
+    assert uci(board) == ["f8c5", "e1g1"]
+
+
+def test_attach_takes_back_moves():
+    sessions = SessionManager(600.0, LOGGER)
+    session, _ = sessions.attach(position("e4", "e5"))
+    sessions.attach(position("e4", "e5", "Nf3", "Nc6"))
+
+    taken_back, board = sessions.attach(position("e4", "e5", "Nf3"))
+    assert taken_back is session
+    assert uci(board) == ["g1f3"]
+
+
+def test_attach_starts_a_new_game_from_the_starting_position():
+    sessions = SessionManager(600.0, LOGGER)
+    session, _ = sessions.attach(position("e4", "e5"))
+    sessions.attach(position("e4", "e5", "Nf3", "Nc6"))
+    sessions.attach(position("e4", "e5", "Nf3", "Nc6", "Bb5", "a6"))
+
+    new_game, board = sessions.attach(chess.Board())
+    assert new_game is not session
+    assert uci(board) == []
+
+
+def test_attach_starts_a_new_game_for_an_unrelated_position():
+    sessions = SessionManager(600.0, LOGGER)
+    session, _ = sessions.attach(position("e4", "e5"))
+
+    other, _ = sessions.attach(position("d4", "d5", "c4", "e6"))
+    assert other is not session
+
+
+def test_boards_in_the_same_position_share_a_session_until_they_diverge():
+    sessions = SessionManager(600.0, LOGGER)
+    first, _ = sessions.attach(chess.Board())
+    second, _ = sessions.attach(chess.Board())
+    assert second is first
+
+    after_e4, _ = sessions.attach(position("e4", "e5"))
+    after_d4, _ = sessions.attach(position("d4", "d5"))
+    assert after_e4 is first
+    assert after_d4 is not first
+
+    # Both games go on in their own sessions
+    assert sessions.attach(position("e4", "e5", "Nf3"))[0] is after_e4
+    assert sessions.attach(position("d4", "d5", "c4"))[0] is after_d4
+
+
+def test_attach_drops_the_least_recently_used_session():
+    sessions = SessionManager(600.0, LOGGER, max_sessions=2)
+    oldest, _ = sessions.attach(position("e4", "e5", "Nf3", "Nc6"))
+    sessions.attach(position("d4", "d5", "c4", "e6"))
+    sessions.attach(position("c4", "c5", "Nc3", "Nc6"))
+
+    replaced, _ = sessions.attach(position("e4", "e5", "Nf3", "Nc6", "Bb5"))
+    assert replaced is not oldest